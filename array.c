@@ -5,11 +5,13 @@
 #include "dict.h"
 #include <string.h>
 
-#define AR_GROW(n) (n + (n >> 1))
+/* the size a full `arr` of `n` entries grows to, at least one more */
+#define AR_GROW(arr, n)                                                       \
+  ((ssize_t)((n) * (arr)->ar_growth) > (n)                                    \
+       ? (ssize_t)((n) * (arr)->ar_growth)                                    \
+       : (n) + 1)
 
-#define AR_TRIM(n) (n << 1) / 3
-
-#define SHOULD_GROW(arr, n) (arr->ar_allocated_count <= n)
+#define SHOULD_GROW(arr, n) (arr->ar_allocated_count < n)
 
 #define AR_ALLOCATED_SIZE(arr) (arr->ar_allocated_count)
 
@@ -19,22 +21,27 @@
 
 static inline void checkindex (entry_list *arr, size_t index);
 
+#define AR_BYTES(n) ((size_t)(n) * sizeof (dt_entry))
+
 static inline int
 array_resize_helper (entry_list *arr, ssize_t new_size)
 {
-  arr->ar_items = SAFEREALLOC (arr->ar_items, new_size * sizeof (dt_entry));
-  if (arr->ar_items == NULL)
+  dt_entry *items = DICT_REALLOC (arr->ar_alloc, arr->ar_items,
+                                  AR_BYTES (arr->ar_allocated_count),
+                                  AR_BYTES (new_size));
+  if (items == NULL)
     return -1;
+  arr->ar_items = items;
   arr->ar_allocated_count = new_size;
   arr->ar_free_count = arr->ar_allocated_count - arr->ar_used_count;
   return 0;
 }
 
 static int
-array_setitem (entry_list *arr, ssize_t ix, dt_entry *en)
+array_setitem (entry_list *arr, ssize_t ix, const dt_entry *en)
 {
   checkindex (arr, ix);
-  arr->ar_items[ix] = en;
+  arr->ar_items[ix] = *en;
   return 1;
 }
 
@@ -42,7 +49,7 @@ dt_entry *
 array_getitem (entry_list *arr, ssize_t ix)
 {
   checkindex (arr, ix);
-  return arr->ar_items[ix];
+  return &arr->ar_items[ix];
 }
 
 static inline int
@@ -51,16 +58,10 @@ array_resize (entry_list *arr)
   assert (arr);
   if (arr->ar_allocated_count <= arr->ar_used_count)
     {
-      ssize_t new_size = AR_GROW (arr->ar_used_count);
-      return array_resize_helper (arr, new_size) == -1;
-    }
-  else if (arr->ar_used_count > MINSIZE
-           && arr->ar_used_count < (arr->ar_allocated_count >> 1))
-    {
-      ssize_t new_size = AR_TRIM (arr->ar_used_count);
+      ssize_t new_size = AR_GROW (arr, arr->ar_used_count);
       return array_resize_helper (arr, new_size) == -1;
     }
-  return 1;
+  return array_shrink (arr) == -1;
 }
 
 int
@@ -69,8 +70,8 @@ array_grow (entry_list *arr, ssize_t n)
   if (SHOULD_GROW (arr, n))
     {
       ssize_t m = AR_ALLOCATED_SIZE (arr);
-      array_resize_helper (arr, AR_GROW (n));
-      if (n >= AR_ALLOCATED_SIZE (arr))
+      array_resize_helper (arr, AR_GROW (arr, n));
+      if (n > AR_ALLOCATED_SIZE (arr))
         return -1;
       if (m == AR_ALLOCATED_SIZE (arr))
         return 1;
@@ -79,16 +80,48 @@ array_grow (entry_list *arr, ssize_t n)
   return 1;
 }
 
+int
+array_shrink (entry_list *arr)
+{
+  assert (arr);
+  ssize_t n = AR_GROW (arr, arr->ar_used_count);
+  if (n < MINSIZE)
+    n = MINSIZE;
+  if (n > (arr->ar_allocated_count >> 1))
+    return 1;
+  return array_resize_helper (arr, n);
+}
+
+int
+array_init (entry_list *arr, size_t nentries, double growth,
+            const dict_allocator *alloc)
+{
+  if (nentries < MINSIZE)
+    nentries = MINSIZE;
+  /* a factor near 1 would reallocate on nearly every append */
+  if (growth < DICT_DEFAULT_ENTRY_GROWTH)
+    growth = DICT_DEFAULT_ENTRY_GROWTH;
+  *arr = (entry_list){ .ar_used_count = 0,
+                       .ar_alloc = alloc,
+                       .ar_growth = growth };
+  ssize_t m = (ssize_t)nentries;
+  arr->ar_items = DICT_ALLOC (alloc, AR_BYTES (m));
+  arr->ar_free_count = m;
+  arr->ar_allocated_count = m;
+  return arr->ar_items ? 0 : -1;
+}
+
 entry_list *
-array_create (size_t nentries)
+array_create (size_t nentries, double growth, const dict_allocator *alloc)
 {
   entry_list *arr = SAFEMALLOC (sizeof (entry_list));
-  size_t m = AR_GROW (nentries);
-  *arr = (entry_list){ .ar_items = SAFEMALLOC (sizeof (dt_entry) * m),
-                       .ar_used_count = 0,
-                       .ar_free_count = m,
-                       .ar_allocated_count = m,
-                       .ar_isfirst = 1 };
+  if (!arr)
+    return NULL;
+  if (array_init (arr, nentries, growth, alloc) != 0)
+    {
+      free (arr);
+      return NULL;
+    }
   return arr;
 }
 
@@ -99,19 +132,21 @@ array_lookup (entry_list *arr, dt_entry *en)
     return -1;
   for (size_t i = 0; i < arr->ar_used_count; i++)
     {
-      if (arr->ar_items[i]->et_key == en->et_key)
+      if (!ENTRY_IS_DELETED (&arr->ar_items[i])
+          && arr->ar_items[i].et_key == en->et_key)
         return i;
     }
   return -1;
 }
 
 int
-array_append (entry_list *arr, dt_entry *item)
+array_append (entry_list *arr, const dt_entry *item)
 {
   assert (arr);
-  if (array_resize (arr) == -1)
+  /* only ever grow here; trimming on append would shrink presized arrays */
+  if (array_grow (arr, arr->ar_used_count + 1) == -1)
     return -1;
-  arr->ar_items[arr->ar_used_count++] = item;
+  arr->ar_items[arr->ar_used_count++] = *item;
   arr->ar_free_count--;
   return 1;
 }
@@ -128,19 +163,20 @@ checkindex (entry_list *arr, size_t index)
 }
 
 void
-array_insert (entry_list *arr, ssize_t index, dt_entry *item)
+array_insert (entry_list *arr, ssize_t index, const dt_entry *item)
 {
   assert (arr);
   checkindex (arr, index);
-  array_resize (arr);
-  for (ssize_t i = index; i < arr->ar_used_count; i++)
-    arr[i + 1] = arr[i];
-  arr->ar_items[index] = item;
+  array_grow (arr, arr->ar_used_count + 1);
+  memmove (arr->ar_items + index + 1, arr->ar_items + index,
+           (arr->ar_used_count - index) * sizeof (dt_entry));
+  arr->ar_items[index] = *item;
   arr->ar_used_count++;
+  arr->ar_free_count--;
 }
 
 int
-array_extend (entry_list *arr, dt_entry **ens, ssize_t nd)
+array_extend (entry_list *arr, const dt_entry *ens, ssize_t nd)
 {
   if (!arr || !ens)
     return -1;
@@ -152,7 +188,7 @@ array_extend (entry_list *arr, dt_entry **ens, ssize_t nd)
   ssize_t last = arr->ar_used_count;
   arr->ar_used_count += nd;
   arr->ar_free_count = arr->ar_allocated_count - arr->ar_used_count;
-  memcpy (arr->ar_items + last, ens, nd * sizeof (dt_entry *));
+  memcpy (arr->ar_items + last, ens, nd * sizeof (dt_entry));
   return 0;
 }
 
@@ -161,8 +197,8 @@ array_delete (entry_list *arr, ssize_t index)
 {
   assert (arr);
   assert (index >= 0 && index < arr->ar_used_count);
-  for (ssize_t i = index + 1; i < arr->ar_used_count; i++)
-    arr->ar_items[i - 1] = arr->ar_items[i];
+  memmove (arr->ar_items + index, arr->ar_items + index + 1,
+           (arr->ar_used_count - index - 1) * sizeof (dt_entry));
   arr->ar_used_count--;
   array_resize (arr);
 }
@@ -172,24 +208,16 @@ array_pop (entry_list *arr)
 {
   assert (arr);
   arr->ar_used_count--;
-  dt_entry *item = arr->ar_items[arr->ar_used_count];
+  dt_entry item = arr->ar_items[arr->ar_used_count];
   array_resize (arr);
-  return *item;
+  return item;
 }
 
 void
 array_free (entry_list *arr)
 {
-  dt_entry *entry = arr->ar_items[0];
-  for (ssize_t i = 0; i < arr->ar_used_count; entry = arr->ar_items[++i])
-    {
-      if (entry != NULL)
-        free (entry);
-    }
-  free (arr->ar_items);
+  array_free_items (arr);
   free (arr);
-  entry_list **loc = &arr;
-  *loc = NULL;
 }
 
 int
@@ -202,41 +230,37 @@ arr_remove_entry (entry_list *arr, ssize_t ix)
     }
   assert (ix >= 0 && ix < arr->ar_used_count);
   dt_entry *en = array_getitem (arr, ix);
-  free (en);
-  array_setitem (arr, ix, NULL);
+  en->et_hashval = DELETED_HASH;
+  memset (&en->et_value, 0, sizeof (en->et_value));
   return 1;
 }
 
+/* entries are stored inline, so only the backing storage is released */
 void
 array_free_items (entry_list *arr)
 {
-  dt_entry *entry = arr->ar_items[0];
-  if (arr->ar_isfirst == 1)
-    {
-      for (ssize_t i = 0; i < arr->ar_used_count; entry = arr->ar_items[++i])
-        {
-          if (entry != NULL)
-            free (entry);
-        }
-    }
-  free (arr->ar_items);
-  free (arr);
+  DICT_FREE (arr->ar_alloc, arr->ar_items,
+             AR_BYTES (arr->ar_allocated_count));
+  arr->ar_items = NULL;
 }
 
-int
-array_copy (entry_list *arr)
+entry_list *
+array_copy (const entry_list *arr)
 {
   entry_list *arr_copy = SAFEMALLOC (sizeof (entry_list));
   if (!arr_copy)
-    return -1;
-  memcpy (arr_copy, arr, sizeof (entry_list));
+    return NULL;
+  *arr_copy = *arr;
   arr_copy->ar_items
-      = SAFEMALLOC (sizeof (dt_entry *) * arr->ar_allocated_count);
+      = DICT_ALLOC (arr->ar_alloc, AR_BYTES (arr->ar_allocated_count));
   if (!arr_copy->ar_items)
-    return -1;
-  memcpy (arr_copy, arr, sizeof (dt_entry *) * arr->ar_allocated_count);
-  arr_copy->ar_isfirst = ~arr->ar_isfirst;
-  return 0;
+    {
+      free (arr_copy);
+      return NULL;
+    }
+  memcpy (arr_copy->ar_items, arr->ar_items,
+          sizeof (dt_entry) * arr->ar_used_count);
+  return arr_copy;
 }
 
 int
@@ -245,25 +269,9 @@ array_clear (entry_list *arr)
   if (!arr)
     return -1;
 
-  if (arr->ar_isfirst == 1)
-    {
-      dt_entry **entries = arr->ar_items;
-      dt_entry *en = *entries;
-      for (ssize_t i = 0; i < arr->ar_used_count; en = *(++entries), i++)
-        {
-          if (en)
-            free (en);
-        }
-    }
-
   arr->ar_used_count = 0;
-  arr->ar_free_count = MINSIZE;
-  arr->ar_items = SAFEREALLOC (arr->ar_items, MINSIZE);
-
-  if (!arr->ar_items)
+  if (array_resize_helper (arr, MINSIZE) != 0)
     return -1;
-
-  arr->ar_allocated_count = MINSIZE;
   return 0;
 }
 
@@ -0,0 +1,397 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+extern "C"
+{
+#include "../dict.h"
+#include "../perf_counters.h"
+}
+
+/*
+ * Every benchmark takes two arguments: the number of keys `n` and a key
+ * distribution. Keys and query streams are generated from fixed seeds, so
+ * runs are reproducible and can be diffed, e.g. through
+ *
+ *   dict_bench --benchmark_out=dict.json --benchmark_out_format=json
+ */
+
+#ifndef DICT_BENCH_MAX_SIZE
+#define DICT_BENCH_MAX_SIZE (100000000)
+#endif
+
+/* length of the query streams cycled through by the per-key benchmarks */
+#define QUERY_STREAM_MAX (1 << 20)
+
+enum distribution
+{
+  DIST_UNIFORM,     // random doubles
+  DIST_SEQUENTIAL,  // 0, 1, 2, ...
+  DIST_CLUSTERED,   // runs of 1024 keys 0.25 apart
+  DIST_ZIPFIAN,     // random doubles, queried with a zipf(0.99) skew
+};
+
+static const char *dist_names[]
+    = { "uniform", "sequential", "clustered", "zipfian" };
+
+static char value_a[] = "a";
+static char value_b[] = "b";
+
+/*
+ * Ranks in [0, n) with P(rank k) proportional to 1 / (k + 1)^theta, drawn
+ * with the method of Gray et al., "Quickly generating billion-record
+ * synthetic databases" (as used by YCSB).
+ */
+class zipf_generator
+{
+public:
+  zipf_generator (uint64_t n, double theta) : n (n), theta (theta)
+  {
+    double zeta2 = 1.0 + std::pow (0.5, theta);
+    for (uint64_t i = 1; i <= n; i++)
+      zetan += 1.0 / std::pow ((double)i, theta);
+    alpha = 1.0 / (1.0 - theta);
+    eta = (1.0 - std::pow (2.0 / (double)n, 1.0 - theta))
+          / (1.0 - zeta2 / zetan);
+  }
+
+  uint64_t
+  operator() (std::mt19937_64 &rng)
+  {
+    double u = std::uniform_real_distribution<double> (0.0, 1.0) (rng);
+    double uz = u * zetan;
+    if (uz < 1.0)
+      return 0;
+    if (uz < 1.0 + std::pow (0.5, theta))
+      return 1;
+    uint64_t k = (uint64_t)((double)n * std::pow (eta * u - eta + 1, alpha));
+    return k < n ? k : n - 1;
+  }
+
+private:
+  uint64_t n;
+  double theta, zetan = 0, alpha, eta;
+};
+
+/*
+ * The keys of a dict of `n` entries and the streams of operations run
+ * against it. `stream` is the order in which inserts, deletes and
+ * overwrites touch the keys; for DIST_ZIPFIAN it repeats popular keys.
+ */
+struct dataset
+{
+  int64_t n;
+  int dist;
+  uint64_t seed;
+  std::vector<dkey_t> keys;
+  std::vector<dkey_t> stream;
+  std::vector<dkey_t> hits;    // QUERY_STREAM_MAX or fewer present keys
+  std::vector<dkey_t> misses;  // as many absent keys
+  dict *base = nullptr;        // a dict holding `keys`
+
+  ~dataset ()
+  {
+    if (base)
+      dict_free (base);
+  }
+};
+
+/* the dataset of the last benchmark; consecutive runs mostly share one */
+static std::unique_ptr<dataset> current;
+
+static const dataset &
+get_dataset (int64_t n, int dist)
+{
+  if (current && current->n == n && current->dist == dist)
+    return *current;
+  current.reset ();
+  current.reset (new dataset);
+  dataset &ds = *current;
+  ds.n = n;
+  ds.dist = dist;
+  ds.seed = 42 + dist;
+  std::mt19937_64 rng (ds.seed);
+
+  ds.keys.resize (n);
+  for (int64_t i = 0; i < n; i++)
+    {
+      if (dist == DIST_SEQUENTIAL)
+        ds.keys[i] = (dkey_t)i;
+      else if (dist == DIST_CLUSTERED)
+        ds.keys[i] = (double)(i >> 10) * 1e6 + (double)(i & 1023) * 0.25;
+      else
+        ds.keys[i]
+            = std::uniform_real_distribution<double> (0.0, 4294967296.0) (rng);
+    }
+
+  if (dist == DIST_ZIPFIAN)
+    {
+      zipf_generator zipf ((uint64_t)n, 0.99);
+      ds.stream.resize (n);
+      for (int64_t i = 0; i < n; i++)
+        ds.stream[i] = ds.keys[zipf (rng)];
+    }
+  else
+    ds.stream = ds.keys;
+
+  /* lookups visit the keys in an order unrelated to insertion */
+  int64_t q = n < QUERY_STREAM_MAX ? n : QUERY_STREAM_MAX;
+  ds.hits.resize (q);
+  ds.misses.resize (q);
+  for (int64_t i = 0; i < q; i++)
+    {
+      ds.hits[i] = (dist == DIST_ZIPFIAN)
+                       ? ds.stream[i]
+                       : ds.keys[std::uniform_int_distribution<int64_t> (
+                           0, n - 1) (rng)];
+      /* every generated key is positive */
+      ds.misses[i] = -1.0 - ds.hits[i];
+    }
+
+  ds.base = dict_new_empty ();
+  for (int64_t i = 0; i < n; i++)
+    dict_insert (ds.base, ds.keys[i], value_a);
+  return ds;
+}
+
+/*
+ * Hardware counters over the timed part of a benchmark. Events the kernel
+ * or CPU does not provide are left out of the report, so the suite still
+ * runs unprivileged and in VMs.
+ */
+class perf_region
+{
+public:
+  explicit perf_region (benchmark::State &state) : state (state)
+  {
+    if (perf_counters_open (&pc) == 0 && !warned)
+      {
+        fprintf (stderr, "hardware performance counters are unavailable; "
+                         "reporting time only\n");
+        warned = true;
+      }
+    perf_counters_start (&pc);
+  }
+
+  ~perf_region () { perf_counters_close (&pc); }
+
+  void
+  pause ()
+  {
+    perf_counters_stop (&pc);
+    state.PauseTiming ();
+  }
+
+  void
+  resume ()
+  {
+    state.ResumeTiming ();
+    perf_counters_start (&pc);
+  }
+
+  /* stop counting and report every available event per item processed */
+  void
+  report (int64_t items)
+  {
+    perf_counters_stop (&pc);
+    for (int e = 0; e < PERF_EVENT_COUNT; e++)
+      if (items > 0 && perf_counters_available (&pc, (perf_event_t)e))
+        state.counters[std::string (perf_event_names[e]) + "/op"]
+            = (double)pc.pc_counts[e] / (double)items;
+  }
+
+private:
+  benchmark::State &state;
+  perf_counters pc;
+  static bool warned;
+};
+
+bool perf_region::warned = false;
+
+static void
+set_labels (benchmark::State &state, const dataset &ds, int64_t items,
+            perf_region &perf)
+{
+  state.SetLabel (std::string (dist_names[ds.dist]) + " seed="
+                  + std::to_string (ds.seed));
+  state.SetItemsProcessed ((int64_t)state.iterations () * items);
+  perf.report ((int64_t)state.iterations () * items);
+}
+
+static void
+BM_Insert (benchmark::State &state)
+{
+  const dataset &ds = get_dataset (state.range (0), (int)state.range (1));
+  perf_region perf (state);
+  for (auto _ : state)
+    {
+      dict *dt = dict_new_empty ();
+      for (dkey_t key : ds.stream)
+        dict_insert (dt, key, value_a);
+      perf.pause ();
+      dict_free (dt);
+      perf.resume ();
+    }
+  set_labels (state, ds, ds.n, perf);
+}
+
+static void
+BM_LookupHit (benchmark::State &state)
+{
+  const dataset &ds = get_dataset (state.range (0), (int)state.range (1));
+  perf_region perf (state);
+  size_t i = 0, q = ds.hits.size ();
+  for (auto _ : state)
+    {
+      benchmark::DoNotOptimize (dict_getvalue (ds.base, ds.hits[i]));
+      if (++i == q)
+        i = 0;
+    }
+  set_labels (state, ds, 1, perf);
+}
+
+static void
+BM_LookupMiss (benchmark::State &state)
+{
+  const dataset &ds = get_dataset (state.range (0), (int)state.range (1));
+  perf_region perf (state);
+  size_t i = 0, q = ds.misses.size ();
+  for (auto _ : state)
+    {
+      benchmark::DoNotOptimize (dict_getvalue (ds.base, ds.misses[i]));
+      if (++i == q)
+        i = 0;
+    }
+  set_labels (state, ds, 1, perf);
+}
+
+static void
+BM_Delete (benchmark::State &state)
+{
+  const dataset &ds = get_dataset (state.range (0), (int)state.range (1));
+  perf_region perf (state);
+  for (auto _ : state)
+    {
+      perf.pause ();
+      dict *dt = dict_copy (ds.base);
+      perf.resume ();
+      for (dkey_t key : ds.stream)
+        dict_delitem (dt, key);
+      perf.pause ();
+      dict_free (dt);
+      perf.resume ();
+    }
+  set_labels (state, ds, ds.n, perf);
+}
+
+static void
+BM_Overwrite (benchmark::State &state)
+{
+  const dataset &ds = get_dataset (state.range (0), (int)state.range (1));
+  perf_region perf (state);
+  dict *dt = dict_copy (ds.base);
+  bool flip = false;
+  for (auto _ : state)
+    {
+      /* alternate the value, since storing the same value is not an
+         overwrite */
+      flip = !flip;
+      for (dkey_t key : ds.stream)
+        dict_insert (dt, key, flip ? value_b : value_a);
+    }
+  dict_free (dt);
+  set_labels (state, ds, ds.n, perf);
+}
+
+static void
+BM_Iterate (benchmark::State &state)
+{
+  const dataset &ds = get_dataset (state.range (0), (int)state.range (1));
+  perf_region perf (state);
+  for (auto _ : state)
+    {
+      itemset *items = dict_getitems (ds.base);
+      benchmark::DoNotOptimize (items);
+      perf.pause ();
+      dict_freeitems (items);
+      perf.resume ();
+    }
+  set_labels (state, ds, ds.n, perf);
+}
+
+static void
+BM_Copy (benchmark::State &state)
+{
+  const dataset &ds = get_dataset (state.range (0), (int)state.range (1));
+  perf_region perf (state);
+  for (auto _ : state)
+    {
+      dict *dt = dict_copy (ds.base);
+      perf.pause ();
+      dict_free (dt);
+      perf.resume ();
+    }
+  set_labels (state, ds, ds.n, perf);
+}
+
+static void
+BM_Update (benchmark::State &state)
+{
+  const dataset &ds = get_dataset (state.range (0), (int)state.range (1));
+  perf_region perf (state);
+  for (auto _ : state)
+    {
+      dict *dt = dict_new_empty ();
+      dict_update (dt, ds.base, 1);
+      perf.pause ();
+      dict_free (dt);
+      perf.resume ();
+    }
+  set_labels (state, ds, ds.n, perf);
+}
+
+static void
+BM_Clear (benchmark::State &state)
+{
+  const dataset &ds = get_dataset (state.range (0), (int)state.range (1));
+  perf_region perf (state);
+  for (auto _ : state)
+    {
+      perf.pause ();
+      dict *dt = dict_copy (ds.base);
+      perf.resume ();
+      dict_clear (dt);
+      perf.pause ();
+      dict_free (dt);
+      perf.resume ();
+    }
+  set_labels (state, ds, ds.n, perf);
+}
+
+/* sizes 1K, 10K, ... DICT_BENCH_MAX_SIZE over every distribution */
+static void
+sizes_and_distributions (benchmark::internal::Benchmark *b)
+{
+  b->ArgNames ({ "n", "dist" });
+  b->ArgsProduct ({ benchmark::CreateRange (1000, DICT_BENCH_MAX_SIZE, 10),
+                    { DIST_UNIFORM, DIST_SEQUENTIAL, DIST_CLUSTERED,
+                      DIST_ZIPFIAN } });
+}
+
+BENCHMARK (BM_Insert)->Apply (sizes_and_distributions);
+BENCHMARK (BM_LookupHit)->Apply (sizes_and_distributions);
+BENCHMARK (BM_LookupMiss)->Apply (sizes_and_distributions);
+BENCHMARK (BM_Delete)->Apply (sizes_and_distributions);
+BENCHMARK (BM_Overwrite)->Apply (sizes_and_distributions);
+BENCHMARK (BM_Iterate)->Apply (sizes_and_distributions);
+BENCHMARK (BM_Copy)->Apply (sizes_and_distributions);
+BENCHMARK (BM_Update)->Apply (sizes_and_distributions);
+BENCHMARK (BM_Clear)->Apply (sizes_and_distributions);
+
+BENCHMARK_MAIN ();
@@ -1,6 +1,8 @@
 
 #include "dict.h"
 
+#include <stdint.h>
+#include <sys/mman.h>
 
 void *safe_malloc(size_t n, unsigned long line)
 {
@@ -21,3 +23,202 @@ void *safe_realloc(void *p, size_t n, unsigned long line)
         }
         return P;
 }
+
+/*
+ * malloc and realloc for the allocator vtables. These are called through
+ * DICT_ALLOC and DICT_REALLOC and cannot see where that happened, so their
+ * failures are reported without a location.
+ */
+static void *
+report_malloc(size_t n)
+{
+        void *p = malloc(n);
+        if (!p)
+                fprintf(stderr, "Out of memory(%zu bytes)\n", n);
+        return p;
+}
+
+static void *
+report_realloc(void *p, size_t n)
+{
+        void *q = realloc(p, n);
+        if (!q)
+                fprintf(stderr, "Out of memory(%zu bytes)\n", n);
+        return q;
+}
+
+static void *
+malloc_alloc(void *ctx, size_t n)
+{
+        (void)ctx;
+        return report_malloc(n);
+}
+
+static void *
+malloc_realloc(void *ctx, void *p, size_t old_n, size_t n)
+{
+        (void)ctx;
+        (void)old_n;
+        return report_realloc(p, n);
+}
+
+static void
+malloc_free(void *ctx, void *p, size_t n)
+{
+        (void)ctx;
+        (void)n;
+        free(p);
+}
+
+const dict_allocator dict_malloc_allocator = {
+        .da_alloc = malloc_alloc,
+        .da_realloc = malloc_realloc,
+        .da_free = malloc_free,
+        .da_ctx = NULL,
+};
+
+static inline const dict_allocator *
+backing(const alloc_stats *stats)
+{
+        return stats->as_backing ? stats->as_backing : &dict_malloc_allocator;
+}
+
+static void *
+counting_alloc(void *ctx, size_t n)
+{
+        alloc_stats *stats = ctx;
+        void *p = DICT_ALLOC(backing(stats), n);
+        if (p) {
+                stats->as_allocs++;
+                stats->as_live_bytes += n;
+                if (stats->as_live_bytes > stats->as_peak_bytes)
+                        stats->as_peak_bytes = stats->as_live_bytes;
+        }
+        return p;
+}
+
+static void *
+counting_realloc(void *ctx, void *p, size_t old_n, size_t n)
+{
+        alloc_stats *stats = ctx;
+        void *q = DICT_REALLOC(backing(stats), p, old_n, n);
+        if (q) {
+                stats->as_reallocs++;
+                stats->as_live_bytes += n - old_n;
+                if (stats->as_live_bytes > stats->as_peak_bytes)
+                        stats->as_peak_bytes = stats->as_live_bytes;
+        }
+        return q;
+}
+
+static void
+counting_free(void *ctx, void *p, size_t n)
+{
+        alloc_stats *stats = ctx;
+        if (!p)
+                return;
+        DICT_FREE(backing(stats), p, n);
+        stats->as_frees++;
+        stats->as_live_bytes -= n;
+}
+
+dict_allocator
+counting_allocator(alloc_stats *stats)
+{
+        return (dict_allocator){ .da_alloc = counting_alloc,
+                                 .da_realloc = counting_realloc,
+                                 .da_free = counting_free,
+                                 .da_ctx = stats };
+}
+
+#ifdef MAP_ANONYMOUS
+
+/* `n` bytes rounded up to whole huge pages */
+#define HUGE_ROUND(n) (((n) + DICT_HUGEPAGE_SIZE - 1) & ~(DICT_HUGEPAGE_SIZE - 1))
+
+static void *
+huge_map(size_t n)
+{
+        const int prot = PROT_READ | PROT_WRITE;
+        const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        n = HUGE_ROUND(n);
+#ifdef MAP_HUGETLB
+        void *p = mmap(NULL, n, prot, flags | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+                return p;
+#endif
+        /* map a page more than needed and cut out a 2 MiB aligned run */
+        size_t len = n + DICT_HUGEPAGE_SIZE;
+        char *q = mmap(NULL, len, prot, flags, -1, 0);
+        if (q == MAP_FAILED) {
+                fprintf(stderr, "Out of memory(%zu bytes)\n", n);
+                return NULL;
+        }
+        char *start = (char *)HUGE_ROUND((uintptr_t)q);
+        if (start > q)
+                munmap(q, start - q);
+        if (q + len > start + n)
+                munmap(start + n, q + len - (start + n));
+#ifdef MADV_HUGEPAGE
+        madvise(start, n, MADV_HUGEPAGE);
+#endif
+        return start;
+}
+
+static void *
+huge_alloc(void *ctx, size_t n)
+{
+        (void)ctx;
+        if (n < DICT_HUGEPAGE_SIZE)
+                return report_malloc(n);
+        return huge_map(n);
+}
+
+static void
+huge_free(void *ctx, void *p, size_t n)
+{
+        (void)ctx;
+        if (!p)
+                return;
+        if (n < DICT_HUGEPAGE_SIZE)
+                free(p);
+        else
+                munmap(p, HUGE_ROUND(n));
+}
+
+static void *
+huge_realloc(void *ctx, void *p, size_t old_n, size_t n)
+{
+        if (!p)
+                return huge_alloc(ctx, n);
+        if (old_n < DICT_HUGEPAGE_SIZE && n < DICT_HUGEPAGE_SIZE)
+                return report_realloc(p, n);
+        if (old_n >= DICT_HUGEPAGE_SIZE && n >= DICT_HUGEPAGE_SIZE
+            && HUGE_ROUND(old_n) == HUGE_ROUND(n))
+                return p;
+        void *q = huge_alloc(ctx, n);
+        if (!q)
+                return NULL;
+        memcpy(q, p, old_n < n ? old_n : n);
+        huge_free(ctx, p, old_n);
+        return q;
+}
+
+const dict_allocator dict_hugepage_allocator = {
+        .da_alloc = huge_alloc,
+        .da_realloc = huge_realloc,
+        .da_free = huge_free,
+        .da_ctx = NULL,
+};
+
+#else
+
+/* no anonymous mappings: huge pages are not worth emulating */
+const dict_allocator dict_hugepage_allocator = {
+        .da_alloc = malloc_alloc,
+        .da_realloc = malloc_realloc,
+        .da_free = malloc_free,
+        .da_ctx = NULL,
+};
+
+#endif
@@ -4,9 +4,16 @@
 
 #include "dict.h"
 
+#include <inttypes.h>
+#include <pthread.h>
 #include <string.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "hashes.h"
+#include "value_arena.h"
 
 /* The total number of slots in the dictionary */
 #define DT_SIZE(dt) (dt->dt_allocated_count)
@@ -17,20 +24,33 @@
 #define DT_USED(dt) ((dt)->dt_entries.ar_used_count)
 
 /* Append an entry to the entries array*/
-#define DT_ADD_TO_ENTRIES(dt, entry) array_append (&dt->dt_entries, entry)
+#define DT_ADD_TO_ENTRIES(dt, entry) array_append (&dt->dt_entries, &(entry))
+
+#ifdef DICT_INLINE_VALUES
+
+/* the value of entry `en`, as a dval_t */
+#define ENTRY_VALUE(en) dval_slot_get (&(en)->et_value)
+
+/* whether the value of `en` lives in its dict's value arena */
+#define ENTRY_IN_ARENA(en) ((en)->et_value.vs_tag == DVAL_ARENA)
+
+#else
+
+#define ENTRY_VALUE(en) ((en)->et_value)
+#define ENTRY_IN_ARENA(en) ((en)->et_value != NULL)
+
+#endif
 
 /* entries_array[ix].value = value */
 #define DT_SET_VALUE(dt, ix, value)                                           \
-  (array_getitem (&dt->dt_entries, ix)->et_value = value)
+  entry_set_value (dt->dt_values, array_getitem (&dt->dt_entries, ix), value)
 
 #define IS_POWER_OF_2(x) (((x) & (x - 1)) == 0)
 
-#define DT_GET_ENTRY(dt, ix) ((dt)->dt_entries.ar_items[ix])
-
-#define DT_LAST_ENTRY(dt) (dt->dt_entries.ar_items[dt->dt_entries.ar_used - 1])
+#define DT_GET_ENTRY(dt, ix) (&(dt)->dt_entries.ar_items[ix])
 
-#define DT_SET_ENTRY(dt, ix, entry)                                           \
-  (array_setitem (&(dt->dt_entries), ix, entry))
+#define DT_LAST_ENTRY(dt)                                                     \
+  (&dt->dt_entries.ar_items[dt->dt_entries.ar_used_count - 1])
 
 #define PERTURB_SHIFT ((unsigned)5)
 
@@ -44,11 +64,16 @@ enum
 
 #define NONE (NULL)
 
-#define USABLE_FRACTION(n) (((n) << 1) / 3)
+/* the entries `dt` takes into an index of `n` slots before it resizes */
+#define USABLE_FRACTION(dt, n) ((ssize_t)((n) * (dt)->dt_max_load))
 
-#define ESTIMATE_SIZE(n) (((((n)*3) + 1)) >> 1)
+/* an index size that holds `n` entries of `dt` */
+#define ESTIMATE_SIZE(dt, n) ((ssize_t)((n) / (dt)->dt_max_load) + 1)
 
-#define GROW(d) ((d)->dt_active_entries_count * 3)
+/* the index size of `dt` after a resize: room for dt_growth times its live
+   entries, and for at least one more */
+#define GROW(dt)                                                              \
+  grow_size (dt, (dt)->dt_active_entries_count * (dt)->dt_growth)
 
 #define ACTUAL_SIZE(size)                                                     \
   (IS_POWER_OF_2 (size) ? size : (1 << (64 - __builtin_clzl (size))))
@@ -57,8 +82,72 @@ enum
 
 #define NEEDS_RESIZING(dt) (dt->dt_free_count <= 0)
 
+static inline ssize_t
+grow_size (const dict *dt, double room)
+{
+  ssize_t n = (ssize_t)room > dt->dt_active_entries_count
+                  ? (ssize_t)room
+                  : dt->dt_active_entries_count + 1;
+  ssize_t s = ESTIMATE_SIZE (dt, n);
+  return s < MINSIZE ? MINSIZE : s;
+}
+
 #define MIN_NUM_ENT (5)
 
+/* Number of control bytes probed at once by an INDEX_SWISS dict */
+#define GROUP_WIDTH (16)
+
+/* Control byte states; a full slot holds the 7 bit H2 of its hash */
+#define CTRL_EMPTY ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xfe)
+
+/* H1 picks the first group to probe, H2 is stored in the control byte */
+#define SWISS_H1(h) ((size_t)((((h) >> 7) * 0x9E3779B97F4A7C15ull) >> 32))
+#define SWISS_H2(h) ((uint8_t)((h)&0x7f))
+
+#define IS_SWISS(dt) ((dt)->dt_index_kind == INDEX_SWISS)
+
+#define IS_ROBIN_HOOD(dt) ((dt)->dt_index_kind == INDEX_ROBIN_HOOD)
+
+/* An INDEX_TAGGED dict keeps SLOT_TAG of the hash of the entry in slot i in
+   dt_ctrl[i]. The tag is taken from a multiplicative mix of the hash, since
+   its low bits pick the slot and its top bits are often zero */
+#define IS_TAGGED(dt) ((dt)->dt_index_kind == INDEX_TAGGED)
+#define SLOT_TAG(h) ((uint8_t)(((h)*0x9E3779B97F4A7C15ull) >> 56))
+
+/* where dict_add_entry indexes a key that needs a fresh probe */
+#define NO_SLOT ((ssize_t)-1)
+
+/* An INDEX_ROBIN_HOOD dict stores the probe distance of slot i plus one in
+   dt_ctrl[i], so 0 is an empty slot. Longer distances saturate at RH_DIST_MAX */
+#define RH_DIST_MAX ((uint8_t)0xff)
+#define RH_TAG(d) ((d) < RH_DIST_MAX - 1 ? (uint8_t)((d) + 1) : RH_DIST_MAX)
+
+/* Key sets at least this large are hashed on several threads */
+#define PARALLEL_HASH_MIN (1 << 16)
+
+/* Number of keys whose probes are kept in flight by the batch lookups */
+#define LOOKUP_BATCH (16)
+
+/* Number of entries migrated to the new index by each write while an
+   incremental resize is in progress */
+#define REHASH_STEP (16)
+
+#define IS_REHASHING(dt) ((dt)->dt_old_indices != NULL)
+
+/* Dicts with fewer used entries keep their tombstones until a resize */
+#define COMPACT_MIN (64)
+
+#define IS_COMPACTING(dt) ((dt)->dt_compacting)
+
+/* whether a delete should start compacting `dt`: dt_shrink_at of its used
+   entries are tombstones, and no compaction or resize is under way */
+#define NEEDS_COMPACTION(dt)                                                  \
+  (!(dt)->dt_keep_tombstones && !IS_COMPACTING (dt) && !IS_REHASHING (dt)     \
+   && (dt)->dt_used_count >= COMPACT_MIN                                      \
+   && (double)((dt)->dt_used_count - (dt)->dt_active_entries_count)           \
+          >= (dt)->dt_used_count * (dt)->dt_shrink_at)
+
 static inline void dictkeys_set_index (dict *keys, ssize_t i, ssize_t ix);
 
 static inline ssize_t dictkeys_get_index (const dict *dt, ssize_t i);
@@ -67,20 +156,177 @@ ssize_t dict_new_index (dict *dt, ssize_t minsize);
 
 static void build_indices (dict *dt);
 
-#ifdef PROBE
+static ssize_t build_indices_dedup (dict *dt, ssize_t n);
+
+/*
+ * Store `value` in a fresh entry: as is, or as a copy in `va`, the value
+ * arena of a dict which owns its values. Under DICT_INLINE_VALUES short
+ * values are copied into the entry instead. Returns -1 if out of memory.
+ */
+static inline int
+entry_init_value (value_arena *va, dt_entry *en, dval_t value)
+{
+#ifdef DICT_INLINE_VALUES
+  if (va && value && strlen (value) > DICT_INLINE_MAX)
+    {
+      char *p = value_arena_store (va, value);
+      if (!p)
+        return -1;
+      memcpy (en->et_value.vs_chars, &p, sizeof (p));
+      en->et_value.vs_tag = DVAL_ARENA;
+      return 0;
+    }
+  return dval_slot_set (&en->et_value, value);
+#else
+  if (va && value)
+    {
+      en->et_value = value_arena_store (va, value);
+      return en->et_value ? 0 : -1;
+    }
+  en->et_value = value;
+  return 0;
+#endif
+}
+
+/* let go of the value of a live entry */
+static inline void
+entry_release_value (value_arena *va, dt_entry *en)
+{
+  if (va && ENTRY_IN_ARENA (en))
+    value_arena_release (va, ENTRY_VALUE (en));
+#ifdef DICT_INLINE_VALUES
+  else
+    dval_slot_release (&en->et_value);
+#endif
+}
+
+/* replace the value of a live entry; -1 if out of memory, leaving it be */
+static inline int
+entry_set_value (value_arena *va, dt_entry *en, dval_t value)
+{
+  dt_entry tmp;
+  if (entry_init_value (va, &tmp, value) != 0)
+    return -1;
+  entry_release_value (va, en);
+  en->et_value = tmp.et_value;
+  return 0;
+}
+
+static inline value_kind_t
+dict_value_kind (const dict *dt)
+{
+  if (!dt->dt_values)
+    return VALUES_BORROWED;
+  return dt->dt_values->va_interned ? VALUES_INTERNED : VALUES_OWNED;
+}
+
+/* free the values `dt` owns; its arena, if any, stays usable */
+static void
+release_values (dict *dt)
+{
+  if (dt->dt_values)
+    value_arena_reset (dt->dt_values);
+#ifdef DICT_INLINE_VALUES
+  /* only values too long for their entry are on the heap, and those of a
+     dict with an arena are in it */
+  else
+    {
+      dt_entry *entries = DT_ENTRIES (dt);
+      for (ssize_t i = 0; i < dt->dt_entries.ar_used_count; i++)
+        if (!ENTRY_IS_DELETED (&entries[i]))
+          dval_slot_release (&entries[i].et_value);
+    }
+#endif
+}
+
+/*
+ * Copy the values `dt` keeps in its arena into a new one, and drop the
+ * old one along with the values overwritten or deleted since the last
+ * compaction. If memory runs out, the new arena adopts the old one.
+ */
+static void
+compact_values (dict *dt)
+{
+  value_arena *old = dt->dt_values;
+  value_arena *va = value_arena_new (old->va_interned != NULL);
+  if (!va)
+    return;
+  dt_entry *entries = DT_ENTRIES (dt);
+  for (ssize_t i = 0; i < dt->dt_entries.ar_used_count; i++)
+    {
+      dt_entry *en = &entries[i];
+      if (ENTRY_IS_DELETED (en) || !ENTRY_IN_ARENA (en))
+        continue;
+      char *p = value_arena_store (va, ENTRY_VALUE (en));
+      if (!p)
+        {
+          value_arena_adopt (va, old);
+          dt->dt_values = va;
+          return;
+        }
+#ifdef DICT_INLINE_VALUES
+      memcpy (en->et_value.vs_chars, &p, sizeof (p));
+#else
+      en->et_value = p;
+#endif
+    }
+  value_arena_free (old);
+  dt->dt_values = va;
+}
 
-static int N = 0;
+#ifdef DICT_STATS
 
-static double average = 0;
+/* count a lookup of `dt` that took `n` probes in histogram `hist` */
+#define STATS_PROBE(dt, hist, n)                                              \
+  ((dt)->dt_stats.hist[(n) < DICT_PROBE_BUCKETS ? (n)-1                       \
+                                                : DICT_PROBE_BUCKETS - 1]++)
+
+/* declare timespec `t` and start it */
+#define STATS_TIMER_START(t)                                                  \
+  struct timespec t;                                                          \
+  clock_gettime (CLOCK_MONOTONIC, &(t))
+
+/* count a resize of `dt` that started at `t` */
+#define STATS_RESIZE(dt, t)                                                   \
+  do                                                                          \
+    {                                                                         \
+      struct timespec _end;                                                   \
+      clock_gettime (CLOCK_MONOTONIC, &_end);                                 \
+      (dt)->dt_stats.st_resizes++;                                            \
+      (dt)->dt_stats.st_resize_ms += (_end.tv_sec - (t).tv_sec) * 1e3         \
+                                     + (_end.tv_nsec - (t).tv_nsec) / 1e6;    \
+    }                                                                         \
+  while (0)
+
+#else
+
+#define STATS_PROBE(dt, hist, n) ((void)0)
+#define STATS_TIMER_START(t)
+#define STATS_RESIZE(dt, t) ((void)0)
 
 #endif
 
+hash_t
+hash (dkey_t key)
+{
+  return hash_double (key);
+}
+
+hash_t
+dict_hash (const dict *dt, dkey_t key)
+{
+  return (dt->dt_hash_kind == HASH_FAST) ? hash_double_fast (key)
+                                         : hash_double (key);
+}
+
 static inline void
 assert_consistent (dict *dt)
 {
-  ssize_t usable = USABLE_FRACTION (dt->dt_allocated_count);
+  ssize_t usable = USABLE_FRACTION (dt, dt->dt_allocated_count);
 
-  assert (0 <= dt->dt_used_count && dt->dt_used_count <= usable);
+  /* dt_used_count counts entry slots, deleted ones included, so it is only
+     bounded by the index until the next resize drops their tombstones */
+  assert (dt->dt_used_count == dt->dt_entries.ar_used_count);
   assert (IS_POWER_OF_2 (dt->dt_allocated_count));
   assert (0 <= dt->dt_free_count && dt->dt_free_count <= usable);
   assert (0 <= dt->dt_active_entries_count
@@ -88,61 +334,177 @@ assert_consistent (dict *dt)
   assert (dt->dt_free_count + dt->dt_active_entries_count <= usable);
 }
 
-static dt_entry *
-zip_to_entries (dkey_t *keys, dval_t *values, ssize_t n)
+/*
+ * Fill `entries` with the (hash, key, value) tuples of the given keys.
+ * Returns -1 if a value could not be copied; its entry is then left with
+ * NULL, so that every entry holds a value the dict can release.
+ */
+static int
+zip_to_entries (const dict *dt, dt_entry *entries, dkey_t *keys,
+                dval_t *values, ssize_t n)
 {
-  if (!keys || n <= 0)
-    {
-      printf ("Keys must be provided.\n");
-      return NULL;
-    }
-  dt_entry *entries = SAFEMALLOC (sizeof (dt_entry) * n);
-  if (values)
-    {
-      for (ssize_t i = 0; i < n; i++)
-        {
-          entries[i] = (dt_entry){ hash (keys[i]), keys[i], values[i] };
-        }
-    }
-  else
+  int status = 0;
+  for (ssize_t i = 0; i < n; i++)
     {
-      for (ssize_t i = 0; i < n; i++)
+      entries[i].et_hashval = dict_hash (dt, keys[i]);
+      entries[i].et_key = keys[i];
+      if (entry_init_value (dt->dt_values, &entries[i],
+                            values ? values[i] : NULL)
+          != 0)
         {
-          entries[i] = (dt_entry){ hash (keys[i]), keys[i], NULL };
+          entry_init_value (NULL, &entries[i], NULL);
+          status = -1;
         }
     }
-  return entries;
+  return status;
+}
+
+typedef struct zip_task
+{
+  const dict *dt;
+  dt_entry *entries;
+  dkey_t *keys;
+  dval_t *values;
+  ssize_t n;
+  int status;
+} zip_task;
+
+static void *
+zip_worker (void *arg)
+{
+  zip_task *t = arg;
+  t->status = zip_to_entries (t->dt, t->entries, t->keys, t->values, t->n);
+  return NULL;
+}
+
+/* zip_to_entries, with the keys split into chunks hashed on `nthreads` */
+static int
+zip_to_entries_parallel (const dict *dt, dt_entry *entries, dkey_t *keys,
+                         dval_t *values, ssize_t n, int nthreads)
+{
+  if (nthreads <= 1 || n < PARALLEL_HASH_MIN)
+    return zip_to_entries (dt, entries, keys, values, n);
+  pthread_t threads[nthreads];
+  zip_task tasks[nthreads];
+  bool started[nthreads];
+  ssize_t chunk = (n + nthreads - 1) / nthreads;
+
+  for (int t = 0; t < nthreads; t++)
+    {
+      ssize_t lo = t * chunk;
+      ssize_t len = (n - lo < chunk) ? n - lo : chunk;
+      tasks[t] = (zip_task){ dt, entries + lo, keys + lo,
+                             values ? values + lo : NULL, len > 0 ? len : 0,
+                             0 };
+      /* the calling thread takes the first chunk */
+      started[t] = t > 0
+                   && pthread_create (&threads[t], NULL, zip_worker, &tasks[t])
+                          == 0;
+    }
+  for (int t = 0; t < nthreads; t++)
+    if (!started[t])
+      zip_worker (&tasks[t]);
+  int status = 0;
+  for (int t = 0; t < nthreads; t++)
+    {
+      if (started[t])
+        pthread_join (threads[t], NULL);
+      if (tasks[t].status != 0)
+        status = -1;
+    }
+  return status;
+}
+
+/*
+ * Free a dict that could not be built. Only its first `nvalues` entries
+ * hold values of its own; the arrays it has not allocated yet are NULL.
+ */
+static dict *
+dict_discard (dict *dt, ssize_t nvalues)
+{
+  dt->dt_entries.ar_used_count = dt->dt_used_count = nvalues;
+  dict_free (dt);
+  return NULL;
 }
 
 dict *
-dict_new_presized (size_t nentries)
+dict_new_configured (size_t nentries, const dict_config *config)
 {
-  dict *d = SAFEMALLOC (sizeof (dict));
-  entry_list *arr = array_create (nentries);
-  if (!arr)
+  if (config->max_load < 0 || config->max_load >= 1 || config->growth < 0
+      || (config->growth && config->growth <= 1) || config->shrink_at < 0
+      || config->shrink_at > 1)
+    {
+      fprintf (stderr, "invalid sizing policy\n");
+      return NULL;
+    }
+  const dict_allocator *alloc
+      = config->allocator ? config->allocator : &dict_malloc_allocator;
+  dict *d = DICT_ALLOC (alloc, sizeof (dict));
+  if (!d)
+    return NULL;
+  entry_list arr;
+  if (array_init (&arr, nentries, config->growth, alloc) != 0)
     {
       fprintf (stderr, "array create failed\n");
+      DICT_FREE (alloc, d, sizeof (dict));
       return NULL;
     }
-  ssize_t estimate = ACTUAL_SIZE (ESTIMATE_SIZE (nentries));
-
-  *d = (dict){ .dt_entries = *arr,
-               .dt_free_count = USABLE_FRACTION (estimate),
+  *d = (dict){ .dt_entries = arr,
+               .dt_alloc = alloc,
+               .dt_free_count = 0,
                .dt_active_entries_count = 0,
                .dt_indices = NULL,
+               .dt_ctrl = NULL,
                .dt_used_count = 0,
-               .dt_allocated_count = 0 };
-  free (arr);
+               .dt_allocated_count = 0,
+               .dt_index_kind = config->index_kind,
+               .dt_hash_kind = config->hash_kind,
+               .dt_max_load = config->max_load ? config->max_load
+                                               : DICT_DEFAULT_MAX_LOAD,
+               .dt_growth = config->growth ? config->growth
+                                           : DICT_DEFAULT_GROWTH,
+               .dt_shrink_at = config->shrink_at ? config->shrink_at
+                                                 : DICT_DEFAULT_SHRINK_AT,
+               .dt_incremental_resize = config->incremental_resize,
+               .dt_keep_tombstones = config->keep_tombstones };
+  ssize_t estimate = ESTIMATE_SIZE (d, (ssize_t)nentries);
+  if (estimate < MINSIZE)
+    estimate = MINSIZE;
+  if (config->value_kind != VALUES_BORROWED)
+    {
+      d->dt_values = value_arena_new (config->value_kind == VALUES_INTERNED);
+      if (!d->dt_values)
+        {
+          fprintf (stderr, "value arena create failed\n");
+          return dict_discard (d, 0);
+        }
+    }
   if (dict_new_index (d, estimate) < 0)
     {
       fprintf (stderr, "dict new index error\n");
-      return NULL;
+      return dict_discard (d, 0);
     }
+  d->dt_free_count = USABLE_FRACTION (d, d->dt_allocated_count);
   return d;
 }
 
 dict *
-dict_new_initialized (dkey_t *keys, dval_t *values, size_t n)
+dict_new_with_index (size_t nentries, index_kind_t kind)
+{
+  dict_config config = { .index_kind = kind,
+                         .hash_kind = DICT_DEFAULT_HASH };
+  return dict_new_configured (nentries, &config);
+}
+
+dict *
+dict_new_presized (size_t nentries)
+{
+  return dict_new_with_index (nentries, INDEX_COMPACT);
+}
+
+dict *
+dict_new_initialized_parallel (dkey_t *keys, dval_t *values, size_t n,
+                               int nthreads)
 {
   if (!keys)
     {
@@ -153,112 +515,189 @@ dict_new_initialized (dkey_t *keys, dval_t *values, size_t n)
     {
       return dict_new_empty ();
     }
-  else
+  dict *d = dict_new_presized (n);
+  if (!d)
+    return NULL;
+
+  if (zip_to_entries_parallel (d, DT_ENTRIES (d), keys, values, n, nthreads)
+      != 0)
     {
-      dict *d = dict_new_presized (n);
-      for (ssize_t i = 0; i < n; i++)
-        {
-          dval_t *val = (values == NULL) ? NULL : &values[i];
-          if (dict_insert_with_hash (d, hash (keys[i]), &keys[i], val)
-              > OK_REPLACED)
-            {
-              return NULL;
-            }
-        }
-      assert_consistent (d);
-      return d;
+      fprintf (stderr, "value copy failed\n");
+      return dict_discard (d, n);
     }
+  ssize_t used = build_indices_dedup (d, n);
+
+  d->dt_entries.ar_used_count = used;
+  d->dt_entries.ar_free_count = d->dt_entries.ar_allocated_count - used;
+  d->dt_used_count = used;
+  d->dt_active_entries_count = used;
+  d->dt_free_count -= used;
+  assert_consistent (d);
+  return d;
 }
 
 dict *
-dict_new_empty (void)
+dict_new_initialized (dkey_t *keys, dval_t *values, size_t n)
 {
-  dict *d = SAFEMALLOC (sizeof (dict));
+  return dict_new_initialized_parallel (keys, values, n, 1);
+}
 
-  entry_list *arr = array_create (MINSIZE);
+dict *
+dict_new_empty (void)
+{
+  const dict_allocator *alloc = &dict_malloc_allocator;
+  dict *d = DICT_ALLOC (alloc, sizeof (dict));
+  entry_list arr;
+  if (!d || array_init (&arr, MINSIZE, 0, alloc) != 0)
+    {
+      DICT_FREE (alloc, d, sizeof (dict));
+      return NULL;
+    }
   *d = (dict){
-    .dt_entries = *arr,
+    .dt_entries = arr,
+    .dt_alloc = alloc,
     .dt_free_count = MIN_NUM_ENT,
     .dt_active_entries_count = 0,
     .dt_indices = NULL,
+    .dt_ctrl = NULL,
     .dt_used_count = 0,
     .dt_allocated_count = MINSIZE,
+    .dt_index_kind = INDEX_COMPACT,
+    .dt_hash_kind = DICT_DEFAULT_HASH,
+    .dt_max_load = DICT_DEFAULT_MAX_LOAD,
+    .dt_growth = DICT_DEFAULT_GROWTH,
+    .dt_shrink_at = DICT_DEFAULT_SHRINK_AT,
   };
-  free (arr);
-  dict_new_index (d, MINSIZE);
+  if (dict_new_index (d, MINSIZE) < 0)
+    return dict_discard (d, 0);
   return d;
 }
 
-ssize_t
-dict_new_index (dict *dt, ssize_t minsize)
+/* size in bytes of one slot of an index of `s` slots */
+static inline int
+index_width (ssize_t s)
 {
-  ssize_t s = ACTUAL_SIZE (minsize);
-  int es;
-
-  if (s <= 0xff)
-    { // 255 | (2^8) - 1
-      (dt->dt_indices) = SAFEMALLOC (sizeof (int8_t) * s);
-      es = 1;
-    }
-  else if (s <= 0xffff)
-    { // 65535 | (2^16) - 1
-      (dt->dt_indices) = SAFEMALLOC (sizeof (int16_t) * s);
-      es = 2;
-    }
+  if (s <= 0xff) // 255 | (2^8) - 1
+    return sizeof (int8_t);
+  else if (s <= 0xffff) // 65535 | (2^16) - 1
+    return sizeof (int16_t);
 #if SIZEOF_VOID_P > 4
-  else if (s > 0xffffffff)
-    { // (2^32) - 1
-      (dt->dt_indices) = SAFEMALLOC (sizeof (int64_t) * s);
-      es = 8;
-    }
+  else if (s > 0xffffffff) // (2^32) - 1
+    return sizeof (int64_t);
 #endif
   else
+    return sizeof (int32_t);
+}
+
+/* the number of slots dict_new_index allocates for `minsize` */
+static inline ssize_t
+index_size (const dict *dt, ssize_t minsize)
+{
+  ssize_t s = ACTUAL_SIZE (minsize);
+
+  /* a swiss index is probed a whole group at a time */
+  if (IS_SWISS (dt) && s < GROUP_WIDTH)
+    s = GROUP_WIDTH;
+  return s;
+}
+
+/* whether the slots of an index of `s` slots can hold entry position `ix` */
+static inline bool
+index_holds (ssize_t s, ssize_t ix)
+{
+  return (size_t)ix < (size_t)1 << (8 * index_width (s) - 1);
+}
+
+ssize_t
+dict_new_index (dict *dt, ssize_t minsize)
+{
+  ssize_t s = index_size (dt, minsize);
+  ssize_t ts = index_width (s) * s;
+  void *indices = DICT_ALLOC (dt->dt_alloc, ts);
+  uint8_t *ctrl = NULL;
+  if (!indices)
+    return -1;
+  if (IS_SWISS (dt) || IS_ROBIN_HOOD (dt) || IS_TAGGED (dt))
     {
-      (dt->dt_indices) = SAFEMALLOC (sizeof (int32_t) * s);
-      es = 4;
+      ctrl = DICT_ALLOC (dt->dt_alloc, s);
+      if (!ctrl)
+        {
+          DICT_FREE (dt->dt_alloc, indices, ts);
+          return -1;
+        }
+      memset (ctrl, IS_SWISS (dt) ? CTRL_EMPTY : 0, s);
     }
-  ssize_t ts = es * s;
-  memset (dt->dt_indices, EMPTY, ts);
+  memset (indices, EMPTY, ts);
+  dt->dt_indices = indices;
+  dt->dt_ctrl = ctrl;
   dt->dt_allocated_count = s;
-  if (!dt->dt_indices)
-    {
-      return -1;
-    }
   return ts;
 }
 
+/* release an index of `n` slots, of either index width */
+static void
+free_index_arrays (dict *dt, void *indices, uint8_t *ctrl, ssize_t n)
+{
+  DICT_FREE (dt->dt_alloc, indices, n * index_width (n));
+  DICT_FREE (dt->dt_alloc, ctrl, n);
+}
+
+/* release the index being migrated away from by an incremental resize */
+static void
+dict_free_old_index (dict *dt)
+{
+  free_index_arrays (dt, dt->dt_old_indices, dt->dt_old_ctrl,
+                     dt->dt_old_allocated_count);
+  dt->dt_old_indices = NULL;
+  dt->dt_old_ctrl = NULL;
+  dt->dt_old_allocated_count = 0;
+  dt->dt_rehash_pos = dt->dt_rehash_end = 0;
+}
+
+/* release the hash index (but not the entries) of `dt` */
+static void
+dict_free_index (dict *dt)
+{
+  free_index_arrays (dt, dt->dt_indices, dt->dt_ctrl, dt->dt_allocated_count);
+  dt->dt_indices = NULL;
+  dt->dt_ctrl = NULL;
+  dict_free_old_index (dt);
+}
+
+/* slot `i` of `indices`, an index of `s` slots */
 static inline ssize_t
-dictkeys_get_index (const dict *dt, ssize_t i)
+index_get (const void *indices, ssize_t s, ssize_t i)
 {
-  ssize_t s = DT_SIZE (dt);
   ssize_t ix;
 
   if (s <= 0xff)
     { // 255 | (2^8) - 1
-      const int8_t *indices = (const int8_t *)(dt->dt_indices);
-      ix = indices[i];
+      ix = ((const int8_t *)indices)[i];
     }
   else if (s <= 0xffff)
     { // 65535 | (2^16) - 1
-      const int16_t *indices = (const int16_t *)(dt->dt_indices);
-      ix = indices[i];
+      ix = ((const int16_t *)indices)[i];
     }
 #if SIZEOF_VOID_P > 4
   else if (s > 0xffffffff)
     { // 4294967295 | (2^32) - 1
-      const int64_t *indices = (const int64_t *)(dt->dt_indices);
-      ix = indices[i];
+      ix = ((const int64_t *)indices)[i];
     }
 #endif
   else
     {
-      const int32_t *indices = (const int32_t *)(dt->dt_indices);
-      ix = indices[i];
+      ix = ((const int32_t *)indices)[i];
     }
   assert (ix >= DUMMY);
   return ix;
 }
 
+static inline ssize_t
+dictkeys_get_index (const dict *dt, ssize_t i)
+{
+  return index_get (dt->dt_indices, DT_SIZE (dt), i);
+}
+
 /* write to indices. */
 static inline void
 dictkeys_set_index (dict *keys, ssize_t i, ssize_t ix)
@@ -294,56 +733,542 @@ dictkeys_set_index (dict *keys, ssize_t i, ssize_t ix)
     }
 }
 
+/* size in bytes of one slot of the index of `dt` */
+static inline int
+dictkeys_index_width (const dict *dt)
+{
+  return index_width (DT_SIZE (dt));
+}
+
+/* bitmask of the slots in the group at `ctrl` whose control byte is `c` */
+static inline unsigned
+group_match (const uint8_t *ctrl, uint8_t c)
+{
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128 ((const __m128i *)ctrl);
+  return (unsigned)_mm_movemask_epi8 (
+      _mm_cmpeq_epi8 (group, _mm_set1_epi8 ((char)c)));
+#else
+  unsigned m = 0;
+  for (unsigned j = 0; j < GROUP_WIDTH; j++)
+    m |= (unsigned)(ctrl[j] == c) << j;
+  return m;
+#endif
+}
+
+/* bitmask of the slots in the group at `ctrl` that are empty or deleted */
+static inline unsigned
+group_match_free (const uint8_t *ctrl)
+{
+#ifdef __SSE2__
+  return (unsigned)_mm_movemask_epi8 (
+      _mm_loadu_si128 ((const __m128i *)ctrl));
+#else
+  unsigned m = 0;
+  for (unsigned j = 0; j < GROUP_WIDTH; j++)
+    m |= (unsigned)(ctrl[j] >> 7) << j;
+  return m;
+#endif
+}
+
+/* the first group of the probe sequence of `hash` in an index of `size`
+   slots */
+static inline size_t
+swiss_first_group (ssize_t size, hash_t hash)
+{
+  return SWISS_H1 (hash) & ((size_t)size / GROUP_WIDTH - 1);
+}
+
+/*
+ * Groups are probed in triangular order (g, g+1, g+3, g+6, ...), which visits
+ * every group of a power of two sized table. A probe stops at the first group
+ * with an empty slot, since an insert would never have moved past it.
+ */
+#define SWISS_NEXT_GROUP(size, g, step)                                       \
+  (((g) + (++(step))) & ((size_t)(size) / GROUP_WIDTH - 1))
+
+/*
+ * The lookups take the index to probe apart from `dt`, whose entries and
+ * statistics they use: the old index of an incremental resize is probed
+ * the same way as the current one.
+ */
+static ssize_t
+swiss_lookup (dict *dt, const void *indices, const uint8_t *ctrl_bytes,
+              ssize_t size, hash_t key_hash, dkey_t key,
+              volatile dval_t *value)
+{
+  uint8_t h2 = SWISS_H2 (key_hash);
+  size_t g = swiss_first_group (size, key_hash);
+
+  for (size_t step = 0;; g = SWISS_NEXT_GROUP (size, g, step))
+    {
+      const uint8_t *ctrl = ctrl_bytes + g * GROUP_WIDTH;
+      for (unsigned m = group_match (ctrl, h2); m; m &= m - 1)
+        {
+          ssize_t i = g * GROUP_WIDTH + __builtin_ctz (m);
+          ssize_t ix = index_get (indices, size, i);
+          dt_entry *maybe = DT_GET_ENTRY (dt, ix);
+          if (key_hash == maybe->et_hashval && maybe->et_key == key)
+            {
+              STATS_PROBE (dt, st_hit_probes, step + 1);
+              *value = ENTRY_VALUE (maybe);
+              return ix;
+            }
+        }
+      if (group_match (ctrl, CTRL_EMPTY))
+        {
+          STATS_PROBE (dt, st_miss_probes, step + 1);
+          *value = NONE;
+          return EMPTY;
+        }
+    }
+}
+
+/* the slot of the index which holds entry `index`, or EMPTY */
+static ssize_t
+swiss_lookdict_index (dict *dt, hash_t hash, ssize_t index)
+{
+  uint8_t h2 = SWISS_H2 (hash);
+  size_t g = swiss_first_group (DT_SIZE (dt), hash);
+
+  for (size_t step = 0;; g = SWISS_NEXT_GROUP (DT_SIZE (dt), g, step))
+    {
+      const uint8_t *ctrl = dt->dt_ctrl + g * GROUP_WIDTH;
+      for (unsigned m = group_match (ctrl, h2); m; m &= m - 1)
+        {
+          ssize_t i = g * GROUP_WIDTH + __builtin_ctz (m);
+          if (dictkeys_get_index (dt, i) == index)
+            return i;
+        }
+      if (group_match (ctrl, CTRL_EMPTY))
+        return EMPTY;
+    }
+}
+
+/* the first empty or deleted slot along the probe sequence of `hash` */
+static ssize_t
+swiss_find_empty_slot (dict *dt, hash_t hash)
+{
+  size_t g = swiss_first_group (DT_SIZE (dt), hash);
+
+  for (size_t step = 0;; g = SWISS_NEXT_GROUP (DT_SIZE (dt), g, step))
+    {
+      unsigned m = group_match_free (dt->dt_ctrl + g * GROUP_WIDTH);
+      if (m)
+        return g * GROUP_WIDTH + __builtin_ctz (m);
+    }
+}
+
+/*
+ * Mark slot `i` as free. If its group still has an empty slot no probe ever
+ * continued past that group, so the slot can become EMPTY instead of a
+ * tombstone.
+ */
+static inline void
+swiss_clear_slot (dict *dt, ssize_t i)
+{
+  const uint8_t *group = dt->dt_ctrl + (i & ~(GROUP_WIDTH - 1));
+  dt->dt_ctrl[i] = group_match (group, CTRL_EMPTY) ? CTRL_EMPTY : CTRL_DELETED;
+  dictkeys_set_index (dt, i, EMPTY);
+}
+
+/*
+ * The slot at which the probe of `hash` starts in an INDEX_ROBIN_HOOD dict.
+ * Probes are linear, so the hash is mixed first: runs of consecutive hashes
+ * would otherwise pile up into one long cluster.
+ */
+static inline size_t
+rh_home (ssize_t size, hash_t hash)
+{
+  return (size_t)((hash * 0x9E3779B97F4A7C15ull)
+                  >> (64 - __builtin_ctzll (size)));
+}
+
+/* the probe distance of the entry in the full slot `i` */
+static inline size_t
+rh_distance (const dict *dt, size_t i)
+{
+  if (dt->dt_ctrl[i] != RH_DIST_MAX)
+    return dt->dt_ctrl[i] - 1;
+  hash_t hash = DT_GET_ENTRY (dt, dictkeys_get_index (dt, i))->et_hashval;
+  return (i - rh_home (DT_SIZE (dt), hash)) & DT_MASK (dt);
+}
+
+/*
+ * A probe ends at the first slot whose entry is closer to its home than the
+ * probe is to its own: an insert of the key would have taken that slot.
+ */
+static ssize_t
+rh_lookup (dict *dt, const void *indices, const uint8_t *ctrl, ssize_t size,
+           hash_t key_hash, dkey_t key, volatile dval_t *value)
+{
+  size_t mask = size - 1;
+  size_t i = rh_home (size, key_hash);
+  size_t d = 0;
+
+  for (; ctrl[i] >= RH_TAG (d); d++, i = (i + 1) & mask)
+    {
+      ssize_t ix = index_get (indices, size, i);
+      dt_entry *maybe = DT_GET_ENTRY (dt, ix);
+      if (key_hash == maybe->et_hashval && maybe->et_key == key)
+        {
+          STATS_PROBE (dt, st_hit_probes, d + 1);
+          *value = ENTRY_VALUE (maybe);
+          return ix;
+        }
+    }
+  STATS_PROBE (dt, st_miss_probes, d + 1);
+  *value = NONE;
+  return EMPTY;
+}
+
+/* the slot of the index which holds entry `index`, or EMPTY */
+static ssize_t
+rh_lookdict_index (dict *dt, hash_t hash, ssize_t index)
+{
+  size_t mask = DT_MASK (dt);
+  size_t i = rh_home (DT_SIZE (dt), hash);
+
+  for (size_t d = 0; dt->dt_ctrl[i] >= RH_TAG (d); d++, i = (i + 1) & mask)
+    if (dictkeys_get_index (dt, i) == index)
+      return i;
+  return EMPTY;
+}
+
+/*
+ * Index entry `ix`, whose key is not in the index yet. Along the way it
+ * takes the slot of the first entry that is closer to its home, which then
+ * continues the probe in its place.
+ */
 static void
-build_indices (dict *dt)
+rh_insert (dict *dt, ssize_t ix, hash_t hash)
 {
-  dt_entry **entries = dt->dt_entries.ar_items;
-  size_t mask = (size_t)DT_SIZE (dt) - 1; // mask
+  size_t mask = DT_MASK (dt);
+  size_t i = rh_home (DT_SIZE (dt), hash);
 
+  for (size_t d = 0;; d++, i = (i + 1) & mask)
+    {
+      if (dt->dt_ctrl[i] == 0)
+        {
+          dictkeys_set_index (dt, i, ix);
+          dt->dt_ctrl[i] = RH_TAG (d);
+          return;
+        }
+      size_t resident = rh_distance (dt, i);
+      if (resident < d)
+        {
+          ssize_t displaced = dictkeys_get_index (dt, i);
+          dictkeys_set_index (dt, i, ix);
+          dt->dt_ctrl[i] = RH_TAG (d);
+          ix = displaced;
+          d = resident;
+        }
+    }
+}
+
+/*
+ * Empty slot `i` by shifting the displaced entries that follow it one slot
+ * back towards their homes, up to the first empty or home slot. No
+ * tombstone is left behind.
+ */
+static void
+rh_clear_slot (dict *dt, size_t i)
+{
+  size_t mask = DT_MASK (dt);
+
+  for (size_t j = (i + 1) & mask; dt->dt_ctrl[j] > RH_TAG (0);
+       i = j, j = (j + 1) & mask)
+    {
+      size_t d = rh_distance (dt, j);
+      dictkeys_set_index (dt, i, dictkeys_get_index (dt, j));
+      dt->dt_ctrl[i] = RH_TAG (d - 1);
+    }
+  dictkeys_set_index (dt, i, EMPTY);
+  dt->dt_ctrl[i] = 0;
+}
+
+/* point slot `i` of the index at entry `ix`, whose hash is `hash` */
+static inline void
+dict_set_slot (dict *dt, ssize_t i, ssize_t ix, hash_t hash)
+{
+  /* the tag first, so that a reader who sees the slot sees its tag */
+  if (IS_TAGGED (dt))
+    dt->dt_ctrl[i] = SLOT_TAG (hash);
+  dictkeys_set_index (dt, i, ix);
+  if (IS_SWISS (dt))
+    dt->dt_ctrl[i] = SWISS_H2 (hash);
+}
+
+/*
+ * The probe loops of INDEX_COMPACT and INDEX_TAGGED, instantiated for each
+ * index width: the `_8` to `_64` versions read the index as an array of
+ * int8_t to int64_t. dictkeys_get_index compares DT_SIZE against the width
+ * limits at every probe; BY_WIDTH picks the version once per call instead.
+ * dt_ctrl is NULL unless the index is INDEX_TAGGED. perturb is unsigned: an
+ * arithmetic shift of a negative hash would stop at -1 and the probe
+ * sequence could cycle without reaching EMPTY.
+ */
+#define DEFINE_PROBES(W, T)                                                   \
+  static inline ssize_t lookdict_##W (dict *dt, const T *indices,             \
+                                      const uint8_t *tags, ssize_t size,      \
+                                      hash_t key_hash, dkey_t key,            \
+                                      volatile dval_t *value)                 \
+  {                                                                           \
+    uint8_t tag = SLOT_TAG (key_hash);                                        \
+    size_t mask = size - 1;                                                   \
+    size_t perturb = (size_t)key_hash;                                        \
+    size_t i = (size_t)key_hash & mask;                                       \
+                                                                              \
+    for (int x = 1;; x++)                                                     \
+      {                                                                       \
+        ssize_t ix = indices[i];                                              \
+        if (ix == EMPTY)                                                      \
+          {                                                                   \
+            STATS_PROBE (dt, st_miss_probes, x);                              \
+            *value = NONE;                                                    \
+            return EMPTY;                                                     \
+          }                                                                   \
+        if (ix >= 0 && (!tags || tags[i] == tag))                             \
+          {                                                                   \
+            dt_entry *maybe = DT_GET_ENTRY (dt, ix);                          \
+            if (key_hash == maybe->et_hashval && maybe->et_key == key)        \
+              {                                                               \
+                STATS_PROBE (dt, st_hit_probes, x);                           \
+                *value = ENTRY_VALUE (maybe);                                 \
+                return ix;                                                    \
+              }                                                               \
+          }                                                                   \
+        perturb >>= PERTURB_SHIFT;                                            \
+        i = mask & (i * 5 + perturb + 1);                                     \
+      }                                                                       \
+  }                                                                           \
+                                                                              \
+  static inline ssize_t lookdict_for_insert_##W (                             \
+      dict *dt, hash_t key_hash, dkey_t key, ssize_t *slot)                   \
+  {                                                                           \
+    const T *indices = dt->dt_indices;                                        \
+    const uint8_t *tags = dt->dt_ctrl;                                        \
+    uint8_t tag = SLOT_TAG (key_hash);                                        \
+    size_t mask = DT_MASK (dt);                                               \
+    size_t perturb = (size_t)key_hash;                                        \
+    size_t i = (size_t)key_hash & mask;                                       \
+                                                                              \
+    for (int x = 1;; x++)                                                     \
+      {                                                                       \
+        ssize_t ix = indices[i];                                              \
+        if (ix == EMPTY)                                                      \
+          {                                                                   \
+            STATS_PROBE (dt, st_miss_probes, x);                              \
+            if (*slot == NO_SLOT)                                             \
+              *slot = i;                                                      \
+            return EMPTY;                                                     \
+          }                                                                   \
+        if (ix < 0)                                                           \
+          {                                                                   \
+            if (*slot == NO_SLOT)                                             \
+              *slot = i;                                                      \
+          }                                                                   \
+        else if (!tags || tags[i] == tag)                                     \
+          {                                                                   \
+            dt_entry *maybe = DT_GET_ENTRY (dt, ix);                          \
+            if (key_hash == maybe->et_hashval && maybe->et_key == key)        \
+              {                                                               \
+                STATS_PROBE (dt, st_hit_probes, x);                           \
+                return ix;                                                    \
+              }                                                               \
+          }                                                                   \
+        perturb >>= PERTURB_SHIFT;                                            \
+        i = mask & (i * 5 + perturb + 1);                                     \
+      }                                                                       \
+  }                                                                           \
+                                                                              \
+  static inline ssize_t find_empty_slot_##W (dict *dt, hash_t hash)           \
+  {                                                                           \
+    const T *indices = dt->dt_indices;                                        \
+    size_t mask = DT_MASK (dt);                                               \
+    size_t i = (size_t)hash & mask;                                           \
+    for (size_t perturb = hash; indices[i] >= 0;)                             \
+      {                                                                       \
+        perturb >>= PERTURB_SHIFT;                                            \
+        i = mask & (i * 5 + perturb + 1);                                     \
+      }                                                                       \
+    return i;                                                                 \
+  }                                                                           \
+                                                                              \
+  static inline ssize_t lookdict_index_##W (dict *dt, hash_t hash,            \
+                                            ssize_t index)                    \
+  {                                                                           \
+    const T *indices = dt->dt_indices;                                        \
+    size_t mask = DT_MASK (dt);                                               \
+    size_t i = (size_t)hash & mask;                                           \
+    for (size_t perturb = hash;;)                                             \
+      {                                                                       \
+        ssize_t ix = indices[i];                                              \
+        if (ix == index)                                                      \
+          return i;                                                           \
+        if (ix == EMPTY)                                                      \
+          return EMPTY;                                                       \
+        perturb >>= PERTURB_SHIFT;                                            \
+        i = mask & (i * 5 + perturb + 1);                                     \
+      }                                                                       \
+  }                                                                           \
+                                                                              \
+  /* index the `m` entries at `entry` in an empty index */                    \
+  static void build_indices_##W (dict *dt, const dt_entry *entry, ssize_t m)  \
+  {                                                                           \
+    T *indices = dt->dt_indices;                                              \
+    uint8_t *tags = dt->dt_ctrl;                                              \
+    size_t mask = DT_MASK (dt);                                               \
+    for (ssize_t ix = 0; ix != m; ++entry, ++ix)                              \
+      {                                                                       \
+        if (ENTRY_IS_DELETED (entry))                                         \
+          continue;                                                           \
+        hash_t hash = entry->et_hashval;                                      \
+        size_t i = hash & mask;                                               \
+        for (size_t perturb = hash; indices[i] != EMPTY;)                     \
+          {                                                                   \
+            perturb >>= PERTURB_SHIFT;                                        \
+            i = mask & (i * 5 + perturb + 1);                                 \
+          }                                                                   \
+        if (tags)                                                             \
+          tags[i] = SLOT_TAG (hash);                                          \
+        indices[i] = (T)ix;                                                   \
+      }                                                                       \
+  }
+
+DEFINE_PROBES (8, int8_t)
+DEFINE_PROBES (16, int16_t)
+DEFINE_PROBES (32, int32_t)
+DEFINE_PROBES (64, int64_t)
+
+/* fn##_8 (...) to fn##_64 (...), whichever matches the width of an index
+   of `size` slots */
+#define BY_INDEX_SIZE(size, fn, ...)                                          \
+  (index_width (size) == 1   ? fn##_8 (__VA_ARGS__)                           \
+   : index_width (size) == 2 ? fn##_16 (__VA_ARGS__)                          \
+   : index_width (size) == 4 ? fn##_32 (__VA_ARGS__)                          \
+                             : fn##_64 (__VA_ARGS__))
+
+/* the same for the index of `dt` */
+#define BY_WIDTH(dt, fn, ...) BY_INDEX_SIZE (DT_SIZE (dt), fn, __VA_ARGS__)
+
+static void
+build_indices (dict *dt)
+{
+  dt_entry *entry = dt->dt_entries.ar_items;
   ssize_t m = dt->dt_entries.ar_used_count;
   assert (m == dt->dt_used_count);
-  dt_entry *entry = *(entries);
-  for (ssize_t ix = 0; ix != m; entry = *(++entries), ++ix)
+  if (IS_SWISS (dt))
+    {
+      for (ssize_t ix = 0; ix != m; ++entry, ++ix)
+        if (!ENTRY_IS_DELETED (entry))
+          dict_set_slot (dt, swiss_find_empty_slot (dt, entry->et_hashval),
+                         ix, entry->et_hashval);
+      return;
+    }
+  if (IS_ROBIN_HOOD (dt))
     {
-      if (entry != NULL)
+      for (ssize_t ix = 0; ix != m; ++entry, ++ix)
+        if (!ENTRY_IS_DELETED (entry))
+          rh_insert (dt, ix, entry->et_hashval);
+      return;
+    }
+  BY_WIDTH (dt, build_indices, dt, entry, m);
+}
+
+/*
+ * Look `key` up in a table without tombstones. Returns the index of its
+ * entry, or EMPTY with `*slot` set to the empty slot that ended the probe,
+ * which is where the key belongs. An INDEX_ROBIN_HOOD dict has no such
+ * slot, since inserts displace entries; `*slot` is left alone. `*slot`
+ * must be NO_SLOT on entry.
+ */
+static ssize_t
+lookup_or_empty_slot (dict *dt, hash_t hash, dkey_t key, ssize_t *slot)
+{
+  if (IS_ROBIN_HOOD (dt))
+    {
+      dval_t value;
+      return rh_lookup (dt, dt->dt_indices, dt->dt_ctrl, DT_SIZE (dt), hash,
+                        key, &value);
+    }
+  if (IS_SWISS (dt))
+    {
+      uint8_t h2 = SWISS_H2 (hash);
+      size_t g = swiss_first_group (DT_SIZE (dt), hash);
+      for (size_t step = 0;; g = SWISS_NEXT_GROUP (DT_SIZE (dt), g, step))
         {
-          hash_t hash = entry->et_hashval;
-          size_t i = hash & mask;
-          for (size_t perturb = hash; dictkeys_get_index (dt, i) != EMPTY;)
+          const uint8_t *ctrl = dt->dt_ctrl + g * GROUP_WIDTH;
+          for (unsigned m = group_match (ctrl, h2); m; m &= m - 1)
             {
-              perturb >>= PERTURB_SHIFT;
-              i = mask & (i * 5 + perturb + 1);
+              ssize_t ix = dictkeys_get_index (
+                  dt, g * GROUP_WIDTH + __builtin_ctz (m));
+              dt_entry *maybe = DT_GET_ENTRY (dt, ix);
+              if (hash == maybe->et_hashval && maybe->et_key == key)
+                return ix;
+            }
+          unsigned empty = group_match (ctrl, CTRL_EMPTY);
+          if (empty)
+            {
+              *slot = g * GROUP_WIDTH + __builtin_ctz (empty);
+              return EMPTY;
             }
-          dictkeys_set_index (dt, i, ix);
         }
     }
+
+  /* no tombstones, so the first free slot is the EMPTY one */
+  return BY_WIDTH (dt, lookdict_for_insert, dt, hash, key, slot);
 }
 
-/**
- * if entry exists in hashtable return that entry(pos), else return empty
- * Search index of hash table from offset of entry table
+/*
+ * Index the `n` entries at the start of the entry array of a freshly
+ * allocated dict in a single pass. A repeated key keeps the position of its
+ * first occurrence and takes the value of its last; the remaining entries
+ * slide down over the duplicates. Returns the number of distinct entries.
  */
 static ssize_t
-lookdict_index (dict *dt, hash_t hash, ssize_t index)
+build_indices_dedup (dict *dt, ssize_t n)
 {
-  size_t mask = DT_MASK (dt);
-  size_t perturb = (size_t)hash;
-  size_t i = (size_t)hash & mask;
+  dt_entry *entries = DT_ENTRIES (dt);
+  ssize_t used = 0;
 
-  for (;;)
+  for (ssize_t j = 0; j < n; j++)
     {
-      ssize_t ix = dictkeys_get_index (dt, i);
-      if (ix == index)
+      dt_entry *en = &entries[j];
+      ssize_t slot = NO_SLOT;
+      ssize_t ix = lookup_or_empty_slot (dt, en->et_hashval, en->et_key, &slot);
+      if (ix >= 0)
         {
-          return i;
+          /* the duplicate's value moves over, and it is not kept */
+          entry_release_value (dt->dt_values, &entries[ix]);
+          entries[ix].et_value = en->et_value;
         }
-      if (ix == EMPTY)
+      else
         {
-          return EMPTY;
+          entries[used] = *en;
+          if (IS_ROBIN_HOOD (dt))
+            rh_insert (dt, used, en->et_hashval);
+          else
+            dict_set_slot (dt, slot, used, en->et_hashval);
+          used++;
         }
-      perturb >>= PERTURB_SHIFT;
-      i = mask & (i * 5 + perturb + 1);
     }
+  return used;
+}
+
+/**
+ * if entry exists in hashtable return that entry(pos), else return empty
+ * Search index of hash table from offset of entry table
+ */
+static ssize_t
+lookdict_index (dict *dt, hash_t hash, ssize_t index)
+{
+  if (IS_SWISS (dt))
+    return swiss_lookdict_index (dt, hash, index);
+  if (IS_ROBIN_HOOD (dt))
+    return rh_lookdict_index (dt, hash, index);
+
+  return BY_WIDTH (dt, lookdict_index, dt, hash, index);
 }
 
 static inline ssize_t
@@ -361,51 +1286,55 @@ get_initial_probe_index (dict *dt, hash_t h)
  * @param value the value
  * @return ssize_t
  */
-ssize_t
-dict_lookup (dict *dt, hash_t key_hash, dkey_t key, volatile dval_t *value)
+static ssize_t
+lookdict (dict *dt, hash_t key_hash, dkey_t key, volatile dval_t *value)
 {
-  if (!dt)
-    {
-      return DICT_IS_NULL;
-    }
-  // The initial probe index is computed as hash mod the table size.
-  ssize_t i = get_initial_probe_index (dt, key_hash);
-  int x = 0;
+  if (IS_SWISS (dt))
+    return swiss_lookup (dt, dt->dt_indices, dt->dt_ctrl, DT_SIZE (dt),
+                         key_hash, key, value);
+  if (IS_ROBIN_HOOD (dt))
+    return rh_lookup (dt, dt->dt_indices, dt->dt_ctrl, DT_SIZE (dt), key_hash,
+                      key, value);
+  return BY_WIDTH (dt, lookdict, dt, dt->dt_indices, dt->dt_ctrl,
+                   DT_SIZE (dt), key_hash, key, value);
+}
 
-  ssize_t mask, perturb;
-  mask = DT_MASK (dt);
-  perturb = key_hash;
+/* lookdict in the index `dt` is migrating away from */
+static ssize_t
+lookdict_old (dict *dt, hash_t key_hash, dkey_t key, volatile dval_t *value)
+{
+  ssize_t size = dt->dt_old_allocated_count;
+  if (IS_SWISS (dt))
+    return swiss_lookup (dt, dt->dt_old_indices, dt->dt_old_ctrl, size,
+                         key_hash, key, value);
+  if (IS_ROBIN_HOOD (dt))
+    return rh_lookup (dt, dt->dt_old_indices, dt->dt_old_ctrl, size,
+                      key_hash, key, value);
+  return BY_INDEX_SIZE (size, lookdict, dt, dt->dt_old_indices,
+                        dt->dt_old_ctrl, size, key_hash, key, value);
+}
 
-  for (;;)
-    {
-      x++;
-      ssize_t ix = dictkeys_get_index (dt, i);
-      if (ix == EMPTY)
-        {
-#ifdef PROBES
-          average = ((average * (N)) + x) / (N + 1);
-          N++;
-#endif
-          *value = NONE;
-          return ix;
-        }
-      if (ix >= 0)
-        {
-          dt_entry *maybe = DT_GET_ENTRY (dt, ix);
-          if ((&key == &maybe->et_key)
-              || (key_hash == maybe->et_hashval && maybe->et_key == key))
-            {
-#ifdef PROBES
-              average = ((average * (N)) + x) / (N + 1);
-              N++;
-#endif
-              *value = maybe->et_value;
-              return ix;
-            }
-        }
-      perturb >>= PERTURB_SHIFT;
-      i = mask & ((i * 5) + perturb + 1);
+/**
+ * @brief Lookup `key` in the index of `dt`, and in its old index if an
+ * incremental resize has not finished migrating it
+ *
+ * @param dt a dictionary object
+ * @param key_hash the hash of the key
+ * @param key the key
+ * @param value the value
+ * @return ssize_t
+ */
+ssize_t
+dict_lookup (dict *dt, hash_t key_hash, dkey_t key, volatile dval_t *value)
+{
+  if (!dt)
+    {
+      return DICT_IS_NULL;
     }
+  ssize_t ix = lookdict (dt, key_hash, key, value);
+  if (ix == EMPTY && IS_REHASHING (dt))
+    ix = lookdict_old (dt, key_hash, key, value);
+  return ix;
 }
 
 dval_t
@@ -432,42 +1361,322 @@ static ssize_t
 find_empty_slot (dict *dt, hash_t hash)
 {
   assert (dt != NULL);
+  if (IS_SWISS (dt))
+    return swiss_find_empty_slot (dt, hash);
+
+  return BY_WIDTH (dt, find_empty_slot, dt, hash);
+}
+
+/* index entry `ix`, whose key is known not to be in the index */
+static inline void
+dict_index_entry (dict *dt, ssize_t ix, hash_t hash)
+{
+  if (IS_ROBIN_HOOD (dt))
+    rh_insert (dt, ix, hash);
+  else
+    dict_set_slot (dt, find_empty_slot (dt, hash), ix, hash);
+}
+
+/* the entries are compacted into [0, `used`); release the rest */
+static void
+dict_compact_end (dict *dt, ssize_t used)
+{
+  dt->dt_compacting = false;
+  dt->dt_used_count = used;
+  dt->dt_entries.ar_used_count = used;
+  dt->dt_entries.ar_free_count = dt->dt_entries.ar_allocated_count - used;
+  array_shrink (&dt->dt_entries);
+}
 
-  size_t i = get_initial_probe_index (dt, hash);
-  ssize_t ix = dictkeys_get_index (dt, i);
+static inline void
+dict_compact_start (dict *dt)
+{
+  dt->dt_compacting = true;
+  dt->dt_compact_from = 0;
+  dt->dt_compact_to = 0;
+}
 
-  const size_t mask = DT_MASK (dt);
+/*
+ * Move the live entries of the next `n` positions the current compaction
+ * has not reached down over the tombstones before them, pointing their
+ * index slots at their new positions. A moved entry leaves a tombstone
+ * behind, so the entries in between are never seen twice. Returns whether
+ * the compaction is done.
+ */
+static bool
+dict_compact_step (dict *dt, ssize_t n)
+{
+  assert (!IS_REHASHING (dt));
+  dt_entry *entries = DT_ENTRIES (dt);
+  ssize_t from = dt->dt_compact_from;
+  ssize_t to = dt->dt_compact_to;
+  ssize_t end = (dt->dt_used_count - from < n) ? dt->dt_used_count : from + n;
 
-  for (size_t perturb = hash; ix >= 0;)
+  for (; from < end; from++)
     {
-      perturb >>= PERTURB_SHIFT;
-      i = (i * 5 + perturb + 1) & mask;
-      ix = dictkeys_get_index (dt, i);
+      if (ENTRY_IS_DELETED (&entries[from]))
+        continue;
+      if (from != to)
+        {
+          ssize_t i = lookdict_index (dt, entries[from].et_hashval, from);
+          assert (i >= 0);
+          entries[to] = entries[from];
+          entries[from].et_hashval = DELETED_HASH;
+          memset (&entries[from].et_value, 0, sizeof (entries[from].et_value));
+          dictkeys_set_index (dt, i, to);
+        }
+      to++;
+    }
+  dt->dt_compact_from = from;
+  dt->dt_compact_to = to;
+  if (from < dt->dt_used_count)
+    return false;
+  dict_compact_end (dt, to);
+  return true;
+}
+
+/* compact the entries of `dt` at once, in place and keeping their order */
+static void
+dict_compact_finish (dict *dt)
+{
+  if (!IS_COMPACTING (dt))
+    dict_compact_start (dt);
+  dict_compact_step (dt, dt->dt_used_count - dt->dt_compact_from);
+}
+
+/* drop the tombstones of the entry array, whose index is to be rebuilt */
+static void
+dict_squeeze_entries (dict *dt)
+{
+  if (dt->dt_used_count == dt->dt_active_entries_count)
+    {
+      dt->dt_compacting = false;
+      return;
     }
-  return i;
+  dt_entry *entries = DT_ENTRIES (dt);
+  ssize_t used = 0;
+  for (ssize_t ix = 0; ix < dt->dt_used_count; ix++)
+    if (!ENTRY_IS_DELETED (&entries[ix]))
+      entries[used++] = entries[ix];
+  dict_compact_end (dt, used);
 }
 
+/* rebuild the index of `dt` at once; -1 if out of memory, keeping the old
+   one and the entries as they were */
 static inline int
 dict_resize (dict *dt, ssize_t minsize)
 {
   assert (dt && minsize >= MINSIZE);
-  free (dt->dt_indices);
-  dt->dt_indices = NULL;
+  STATS_TIMER_START (start);
+  void *indices = dt->dt_indices;
+  uint8_t *ctrl = dt->dt_ctrl;
+  ssize_t allocated = dt->dt_allocated_count;
   if (dict_new_index (dt, minsize) == -1)
     {
       fprintf (stderr, "Memory Error\n");
       return -1;
     }
+  free_index_arrays (dt, indices, ctrl, allocated);
+  dict_free_old_index (dt);
+  dict_squeeze_entries (dt);
   build_indices (dt);
-  dt->dt_free_count
-      = USABLE_FRACTION (dt->dt_allocated_count) - dt->dt_active_entries_count;
+  dt->dt_free_count = USABLE_FRACTION (dt, dt->dt_allocated_count)
+                      - dt->dt_active_entries_count;
+  if (dt->dt_values && value_arena_wants_compaction (dt->dt_values))
+    compact_values (dt);
+  STATS_RESIZE (dt, start);
+  return 0;
+}
+
+/* index up to `n` of the entries the current incremental resize has left */
+static void
+dict_rehash_step (dict *dt, ssize_t n)
+{
+  dt_entry *entries = DT_ENTRIES (dt);
+  ssize_t pos = dt->dt_rehash_pos;
+  ssize_t end = (dt->dt_rehash_end - pos < n) ? dt->dt_rehash_end : pos + n;
+
+  for (; pos < end; pos++)
+    {
+      if (!ENTRY_IS_DELETED (&entries[pos]))
+        dict_index_entry (dt, pos, entries[pos].et_hashval);
+    }
+  dt->dt_rehash_pos = pos;
+  if (pos == dt->dt_rehash_end)
+    dict_free_old_index (dt);
+}
+
+/* finish any incremental resize in progress */
+static inline void
+dict_rehash_finish (dict *dt)
+{
+  if (IS_REHASHING (dt))
+    dict_rehash_step (dt, dt->dt_rehash_end - dt->dt_rehash_pos);
+}
+
+/*
+ * Like dict_resize, but only allocates the new index. The current index is
+ * kept as the old index, and the existing entries are moved over
+ * REHASH_STEP at a time by later writes. Until then lookups consult both.
+ */
+static int
+dict_resize_incremental (dict *dt, ssize_t minsize)
+{
+  assert (dt && minsize >= MINSIZE);
+  STATS_TIMER_START (start);
+  dict_rehash_finish (dt);
+
+  /* entries only move while a single index points at them. Until the next
+     resize, the new index takes positions up to used + usable - active */
+  ssize_t s = index_size (dt, minsize);
+  if (IS_COMPACTING (dt)
+      || !index_holds (s, dt->dt_used_count + USABLE_FRACTION (dt, s)
+                              - dt->dt_active_entries_count))
+    dict_compact_finish (dt);
+
+  void *indices = dt->dt_indices;
+  uint8_t *ctrl = dt->dt_ctrl;
+  ssize_t allocated = dt->dt_allocated_count;
+  if (dict_new_index (dt, minsize) == -1)
+    {
+      fprintf (stderr, "Memory Error\n");
+      return -1;
+    }
+  dt->dt_old_indices = indices;
+  dt->dt_old_ctrl = ctrl;
+  dt->dt_old_allocated_count = allocated;
+  dt->dt_rehash_pos = 0;
+  dt->dt_rehash_end = dt->dt_used_count;
+  dt->dt_free_count = USABLE_FRACTION (dt, dt->dt_allocated_count)
+                      - dt->dt_active_entries_count;
+  if (dt->dt_values && value_arena_wants_compaction (dt->dt_values))
+    compact_values (dt);
+  STATS_RESIZE (dt, start);
+  return 0;
+}
+
+/*
+ * The share of an incremental resize or a compaction a write takes on.
+ * Returns -1 if the index could not be shrunk after a compaction; the dict
+ * is then compacted and consistent, at its old index size.
+ */
+static inline int
+dict_step (dict *dt)
+{
+  if (IS_REHASHING (dt))
+    dict_rehash_step (dt, REHASH_STEP);
+  else if (IS_COMPACTING (dt) && dict_compact_step (dt, REHASH_STEP))
+    return dict_resize_incremental (dt, GROW (dt));
   return 0;
 }
 
+/*
+ * lookdict for inserts: also remembers the first EMPTY or DUMMY slot it
+ * passes, which is the slot find_empty_slot would return for `key_hash`
+ */
+static inline ssize_t
+lookdict_for_insert (dict *dt, hash_t key_hash, dkey_t key, ssize_t *slot)
+{
+  return BY_WIDTH (dt, lookdict_for_insert, dt, key_hash, key, slot);
+}
+
+/* swiss_lookup for inserts, remembering swiss_find_empty_slot's answer */
+static inline ssize_t
+swiss_lookup_for_insert (dict *dt, hash_t key_hash, dkey_t key,
+                         ssize_t *slot)
+{
+  uint8_t h2 = SWISS_H2 (key_hash);
+  size_t g = swiss_first_group (DT_SIZE (dt), key_hash);
+
+  for (size_t step = 0;; g = SWISS_NEXT_GROUP (DT_SIZE (dt), g, step))
+    {
+      const uint8_t *ctrl = dt->dt_ctrl + g * GROUP_WIDTH;
+      for (unsigned m = group_match (ctrl, h2); m; m &= m - 1)
+        {
+          ssize_t ix = dictkeys_get_index (dt, g * GROUP_WIDTH
+                                                   + __builtin_ctz (m));
+          dt_entry *maybe = DT_GET_ENTRY (dt, ix);
+          if (key_hash == maybe->et_hashval && maybe->et_key == key)
+            {
+              STATS_PROBE (dt, st_hit_probes, step + 1);
+              return ix;
+            }
+        }
+      if (*slot == NO_SLOT)
+        {
+          unsigned m = group_match_free (ctrl);
+          if (m)
+            *slot = g * GROUP_WIDTH + __builtin_ctz (m);
+        }
+      if (group_match (ctrl, CTRL_EMPTY))
+        {
+          STATS_PROBE (dt, st_miss_probes, step + 1);
+          return EMPTY;
+        }
+    }
+}
+
+/*
+ * The entry of `key`, or EMPTY and in *slot where dict_add_entry should
+ * index it. That takes a single walk of the probe sequence, except for
+ * robin hood indices, which move entries on insert, during an incremental
+ * resize, and when the index is full anyway; *slot is NO_SLOT then.
+ */
+static inline ssize_t
+dict_find_for_insert (dict *dt, hash_t hash, dkey_t key, ssize_t *slot)
+{
+  *slot = NO_SLOT;
+  if (IS_ROBIN_HOOD (dt) || IS_REHASHING (dt) || NEEDS_RESIZING (dt))
+    {
+      dval_t value;
+      return dict_lookup (dt, hash, key, &value);
+    }
+  if (IS_SWISS (dt))
+    return swiss_lookup_for_insert (dt, hash, key, slot);
+  return lookdict_for_insert (dt, hash, key, slot);
+}
+
+/* append an entry for `key`, which dict_find_for_insert did not find */
+static int
+dict_add_entry (dict *dt, hash_t hash, dkey_t key, dval_t value,
+                ssize_t slot)
+{
+  if (NEEDS_RESIZING (dt))
+    {
+      int resized = dt->dt_incremental_resize
+                        ? dict_resize_incremental (dt, GROW (dt))
+                        : dict_resize (dt, GROW (dt));
+      if (resized != 0)
+        return INTERNAL_ERROR;
+    }
+  // the entry is copied by value into the entry_list of entries
+  dt_entry new_entry = { .et_hashval = hash, .et_key = key };
+  if (entry_init_value (dt->dt_values, &new_entry, value) != 0)
+    return INTERNAL_ERROR;
+  if (DT_ADD_TO_ENTRIES (dt, new_entry) == -1)
+    {
+      entry_release_value (dt->dt_values, &new_entry);
+      return INTERNAL_ERROR;
+    }
+  /* the entry must be visible before the slot that refers to it, for
+     readers probing without a lock (see rcu_dict) */
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  if (slot == NO_SLOT)
+    dict_index_entry (dt, DT_USED (dt) - 1, hash);
+  else
+    dict_set_slot (dt, slot, DT_USED (dt) - 1, hash);
+  dt->dt_used_count++;
+  dt->dt_free_count--;
+  dt->dt_active_entries_count++;
+  return OK;
+}
+
 int
 dict_insert (dict *dt, dkey_t key, dval_t value)
 {
-  hash_t h = hash (key);
+  if (!dt)
+    return INVALID_INPUT;
+  hash_t h = dict_hash (dt, key);
   int ret = dict_insert_with_hash (dt, h, &key, &value);
   assert_consistent (dt);
   return ret;
@@ -480,6 +1689,7 @@ dict_insert (dict *dt, dkey_t key, dval_t value)
  * @param hash
  * @param key
  * @param value
+ * @note hash must not be DELETED_HASH, which tags deleted entries
  * @return int (-1) if any input value is invalid
  *             (0)  if an entirely new
  *             (1)  if key was already in the dictionary
@@ -488,50 +1698,91 @@ int
 dict_insert_with_hash (dict *dt, hash_t hash, const dkey_t *key,
                        const dval_t *value)
 {
-  if (!value || !key || !dt)
+  if (!value || !key || !dt || hash == DELETED_HASH)
     return INVALID_INPUT;
 
-  dval_t oldvalue;
-  // lookup the key, while simulatneously retrieving the value if the key
-  // exists
-  ssize_t ix = dict_lookup (dt, hash, *key, &oldvalue);
+  if (dict_step (dt) != 0)
+    return INTERNAL_ERROR;
+
+  // lookup the key, while simultaneously finding the slot it would take
+  ssize_t slot;
+  ssize_t ix = dict_find_for_insert (dt, hash, *key, &slot);
 
   if (ix == EMPTY)
     // key was not found, so we insert it
-    {
-      if (NEEDS_RESIZING (dt))
-        {
-          dict_resize (dt, GROW (dt));
-        }
-      // we allocate space for a new entry
-      dt_entry *new_entry = SAFEMALLOC (sizeof (dt_entry));
-      *new_entry = (dt_entry){ hash, *key, *value };
-      // we add the entry to the entry_list of entrys
-      DT_ADD_TO_ENTRIES (dt, new_entry);
-      ssize_t hashpos = find_empty_slot (dt, hash);
-      dictkeys_set_index (dt, hashpos, DT_USED (dt) - 1);
-      dt->dt_used_count++;
-      dt->dt_free_count--;
-      dt->dt_active_entries_count++;
-      return OK;
-    }
-  else if (oldvalue != NONE && (oldvalue != *value))
+    return dict_add_entry (dt, hash, *key, *value, slot);
+
+  dval_t oldvalue = ENTRY_VALUE (DT_GET_ENTRY (dt, ix));
+  if (oldvalue != NONE && (oldvalue != *value))
     // key was found, so we overwrite the value at `ix`
     {
-      DT_SET_VALUE (dt, ix, *value);
+      if (DT_SET_VALUE (dt, ix, *value) != 0)
+        return INTERNAL_ERROR;
       return OK_REPLACED;
     }
+  else if (oldvalue != NONE)
+    // key was found with this very value; nothing to overwrite
+    return OK_REPLACED;
   return INTERNAL_ERROR;
 }
 
+int
+dict_upsert (dict *dt, dkey_t key, dict_upsert_fn fn, void *ctx)
+{
+  if (!dt || !fn)
+    return INVALID_INPUT;
+  hash_t hash = dict_hash (dt, key);
+  if (dict_step (dt) != 0)
+    return INTERNAL_ERROR;
+
+  ssize_t slot;
+  ssize_t ix = dict_find_for_insert (dt, hash, key, &slot);
+  if (ix == EMPTY)
+    {
+      dval_t value = fn (key, NONE, ctx);
+      if (value == NONE)
+        return INVALID_INPUT;
+      return dict_add_entry (dt, hash, key, value, slot);
+    }
+
+  dval_t oldvalue = ENTRY_VALUE (DT_GET_ENTRY (dt, ix));
+  dval_t value = fn (key, oldvalue, ctx);
+  if (value == NONE)
+    return INVALID_INPUT;
+  if (value != oldvalue && DT_SET_VALUE (dt, ix, value) != 0)
+    return INTERNAL_ERROR;
+  return OK_REPLACED;
+}
+
+dval_t
+dict_setdefault (dict *dt, dkey_t key, dval_t value)
+{
+  if (!dt)
+    return NONE;
+  hash_t hash = dict_hash (dt, key);
+  if (dict_step (dt) != 0)
+    return NONE;
+
+  ssize_t slot;
+  ssize_t ix = dict_find_for_insert (dt, hash, key, &slot);
+  if (ix == EMPTY)
+    {
+      if (value == NONE || dict_add_entry (dt, hash, key, value, slot) != OK)
+        return NONE;
+      ix = DT_USED (dt) - 1;
+    }
+  return ENTRY_VALUE (DT_GET_ENTRY (dt, ix));
+}
+
 dval_t
 dict_getvalue (dict *dt, dkey_t key)
 {
   if (!dt)
     {
       fprintf (stderr, "null pointer\n");
+      return NONE;
     }
-  hash_t h = hash (key);
+  hash_t h = dict_hash (dt, key);
   return dict_getvalue_knownhash (dt, h, key);
 }
 
@@ -576,11 +1827,11 @@ dict_getvalues (dict *dt)
           = SAFEMALLOC (sizeof (dval_t) * dt->dt_active_entries_count);
       v->vals = values;
       v->n_vals = dt->dt_active_entries_count;
-      dt_entry **entries = DT_ENTRIES (dt);
+      dt_entry *entries = DT_ENTRIES (dt);
 
       for (ssize_t i = 0, j = 0, m = dt->dt_used_count; i < m; i++, entries++)
-        if (entries)
-          values[j++] = (*entries)->et_value;
+        if (!ENTRY_IS_DELETED (entries))
+          values[j++] = ENTRY_VALUE (entries);
 
       return v;
     }
@@ -652,10 +1903,10 @@ dict_getkeys (dict *dt)
       dkey_t *keys = SAFEMALLOC (sizeof (*keys) * dt->dt_active_entries_count);
       ko->key = keys;
       ko->n_keys = dt->dt_active_entries_count;
-      dt_entry **entries = DT_ENTRIES (dt);
+      dt_entry *entries = DT_ENTRIES (dt);
       for (ssize_t i = 0, j = 0, m = dt->dt_entries.ar_used_count; i < m; i++)
-        if (entries[i])
-          keys[j++] = entries[i]->et_key;
+        if (!ENTRY_IS_DELETED (&entries[i]))
+          keys[j++] = entries[i].et_key;
     }
   return ko;
 }
@@ -724,20 +1975,21 @@ dict_getitems (dict *dt)
     }
   itemset *it = SAFEMALLOC (sizeof (itemset));
   item *items = SAFEMALLOC (sizeof (item) * dt->dt_active_entries_count);
-  dt_entry **entries = DT_ENTRIES (dt);
+  dt_entry *entries = DT_ENTRIES (dt);
 
   item t;
-  for (ssize_t i = 0, j = 0; i < dt->dt_entries.ar_used_count; i++)
+  ssize_t j = 0;
+  for (ssize_t i = 0; i < dt->dt_entries.ar_used_count; i++)
     {
-      if (entries[i] != NULL)
+      if (!ENTRY_IS_DELETED (&entries[i]))
         {
-          t = (item){ .key = entries[i]->et_key,
-                      .value = entries[i]->et_value };
+          t = (item){ .key = entries[i].et_key,
+                      .value = ENTRY_VALUE (&entries[i]) };
           items[j++] = t;
         }
     }
   it->items = items;
-  it->n_items = dt->dt_entries.ar_used_count;
+  it->n_items = j;
   return it;
 }
 
@@ -748,13 +2000,105 @@ dict_contains (dict *dict, dkey_t key)
     return -1;
   ssize_t ix;
   dval_t value;
-  hash_t h = hash (key);
+  hash_t h = dict_hash (dict, key);
   ix = dict_lookup (dict, h, key, &value);
   if (ix == DICT_IS_NULL)
     return -1;
   return (ix != EMPTY && value != NONE);
 }
 
+/*
+ * Look up `n` keys in three passes over each batch of LOOKUP_BATCH keys:
+ * hash every key and prefetch its first index slot, then read those slots
+ * and prefetch the entries they point at, and finally resolve each key with
+ * the usual probe. The cache misses of a whole batch are in flight together
+ * instead of being paid one after the other.
+ */
+static ssize_t
+lookup_batch (dict *dt, const dkey_t *keys, ssize_t n, dval_t *values,
+              bool *found)
+{
+  hash_t hashes[LOOKUP_BATCH];
+  ssize_t slots[LOOKUP_BATCH];
+  ssize_t nfound = 0;
+  int width = dictkeys_index_width (dt);
+
+  for (ssize_t base = 0; base < n; base += LOOKUP_BATCH)
+    {
+      const dkey_t *batch = keys + base;
+      ssize_t m = (n - base < LOOKUP_BATCH) ? n - base : LOOKUP_BATCH;
+
+      for (ssize_t j = 0; j < m; j++)
+        {
+          hashes[j] = dict_hash (dt, batch[j]);
+          if (IS_SWISS (dt))
+            {
+              slots[j]
+                  = swiss_first_group (DT_SIZE (dt), hashes[j]) * GROUP_WIDTH;
+              __builtin_prefetch (dt->dt_ctrl + slots[j]);
+            }
+          else if (IS_ROBIN_HOOD (dt))
+            {
+              slots[j] = rh_home (DT_SIZE (dt), hashes[j]);
+              __builtin_prefetch (dt->dt_ctrl + slots[j]);
+            }
+          else
+            {
+              slots[j] = get_initial_probe_index (dt, hashes[j]);
+              if (IS_TAGGED (dt))
+                __builtin_prefetch (dt->dt_ctrl + slots[j]);
+            }
+          __builtin_prefetch ((char *)dt->dt_indices + slots[j] * width);
+        }
+
+      for (ssize_t j = 0; j < m; j++)
+        {
+          ssize_t i = slots[j];
+          if (IS_SWISS (dt))
+            {
+              unsigned match
+                  = group_match (dt->dt_ctrl + i, SWISS_H2 (hashes[j]));
+              if (!match)
+                continue;
+              i += __builtin_ctz (match);
+            }
+          ssize_t ix = dictkeys_get_index (dt, i);
+          if (ix >= 0
+              && (!IS_TAGGED (dt) || dt->dt_ctrl[i] == SLOT_TAG (hashes[j])))
+            __builtin_prefetch (DT_GET_ENTRY (dt, ix));
+        }
+
+      for (ssize_t j = 0; j < m; j++)
+        {
+          dval_t value;
+          ssize_t ix = dict_lookup (dt, hashes[j], batch[j], &value);
+          bool hit = (ix >= 0 && value != NONE);
+          if (values)
+            values[base + j] = hit ? value : NONE;
+          if (found)
+            found[base + j] = hit;
+          nfound += hit;
+        }
+    }
+  return nfound;
+}
+
+ssize_t
+dict_lookup_batch (dict *dt, const dkey_t *keys, ssize_t n, dval_t *values)
+{
+  if (!dt || !keys || !values || n < 0)
+    return -1;
+  return lookup_batch (dt, keys, n, values, NULL);
+}
+
+ssize_t
+dict_contains_batch (dict *dt, const dkey_t *keys, ssize_t n, bool *found)
+{
+  if (!dt || !keys || !found || n < 0)
+    return -1;
+  return lookup_batch (dt, keys, n, NULL, found);
+}
+
 static void
 repr_val (dval_t x, FILE *stream)
 {
@@ -792,11 +2136,10 @@ dict_repr (dict *dt, FILE *stream)
       fprintf (stream, "dict([");
       ssize_t m = dt->dt_active_entries_count;
       bool first = true;
-      dt_entry *entry = dt->dt_entries.ar_items[0];
-      for (ssize_t i = 0; i < dt->dt_entries.ar_used_count;
-           entry = dt->dt_entries.ar_items[++i])
+      dt_entry *entry = dt->dt_entries.ar_items;
+      for (ssize_t i = 0; i < dt->dt_entries.ar_used_count; ++entry, ++i)
         {
-          if (entry)
+          if (!ENTRY_IS_DELETED (entry))
             {
               if (first)
                 first = false;
@@ -805,7 +2148,7 @@ dict_repr (dict *dt, FILE *stream)
 
               repr_key (entry->et_key, stream);
               fprintf (stream, " : ");
-              repr_val (entry->et_value, stream);
+              repr_val (ENTRY_VALUE (entry), stream);
 
               if (--m)
                 fprintf (stream, ",\n ");
@@ -819,21 +2162,38 @@ dict_repr (dict *dt, FILE *stream)
 int
 dict_delitem (dict *dt, dkey_t key)
 {
-  hash_t h = hash (key);
+  if (!dt)
+    return -1;
+  hash_t h = dict_hash (dt, key);
   dval_t oldvalue;
 
+  /* a delete goes ahead even if the index could not shrink */
+  dict_step (dt);
+
   ssize_t index = dict_lookup (dt, h, key, &oldvalue);
   if (index < 0 || oldvalue == NONE)
     return -1; // key not found
   ssize_t i = lookdict_index (dt, h, index);
 
-  dictkeys_set_index (dt, i, DUMMY);
+  /* an entry not yet migrated is only referenced by the old index, where
+     its deleted tag is enough to keep it from matching */
+  if (i == EMPTY)
+    ;
+  else if (IS_SWISS (dt))
+    swiss_clear_slot (dt, i);
+  else if (IS_ROBIN_HOOD (dt))
+    rh_clear_slot (dt, i);
+  else
+    dictkeys_set_index (dt, i, DUMMY);
 
+  entry_release_value (dt->dt_values, DT_GET_ENTRY (dt, index));
   if (arr_remove_entry (&dt->dt_entries, index) == -1)
     {
       return -1;
     }
   dt->dt_active_entries_count -= 1;
+  if (NEEDS_COMPACTION (dt))
+    dict_compact_start (dt);
   return 0;
 }
 
@@ -847,6 +2207,41 @@ print_indices (dict *dt)
     }
   ssize_t s = dt->dt_allocated_count;
   ssize_t m = s;
+  if (IS_SWISS (dt))
+    {
+      printf ("ctrl [");
+      for (ssize_t i = 0; i < s; i++)
+        {
+          switch (dt->dt_ctrl[i])
+            {
+            case (CTRL_EMPTY):
+              printf ("EMPTY");
+              break;
+            case (CTRL_DELETED):
+              printf ("DUMMY");
+              break;
+            default:
+              printf ("%02x", dt->dt_ctrl[i]);
+            }
+          if (i != s - 1)
+            printf (",");
+        }
+      printf ("]\n");
+    }
+  else if (IS_ROBIN_HOOD (dt))
+    {
+      printf ("dist [");
+      for (ssize_t i = 0; i < s; i++)
+        {
+          if (dt->dt_ctrl[i] == 0)
+            printf ("EMPTY");
+          else
+            printf ("%zu", rh_distance (dt, i));
+          if (i != s - 1)
+            printf (",");
+        }
+      printf ("]\n");
+    }
   if (s <= 0xff)
     { // 255 | (2^8) - 1
       printf ("[");
@@ -910,7 +2305,7 @@ print_indices (dict *dt)
               printf ("EMPTY");
               break;
             default:
-              printf ("%lld", t);
+              printf ("%" PRId64, t);
             }
           if (--m)
             printf (",");
@@ -1004,8 +2399,11 @@ dict_free (dict *dt)
       return -1;
     }
   assert (IS_POWER_OF_2 ((dt->dt_allocated_count)));
+  release_values (dt);
+  value_arena_free (dt->dt_values);
   array_free_items (&dt->dt_entries);
-  free (dt->dt_indices);
+  dict_free_index (dt);
+  DICT_FREE (dt->dt_alloc, dt, sizeof (dict));
   return 1;
 }
 
@@ -1016,13 +2414,14 @@ dict_clear (dict *dt)
     {
       return -1; /* null_pointer*/
     }
-  free (dt->dt_indices);
-  dict_new_index (dt, MINSIZE);
-  if (!dt->dt_indices)
+  release_values (dt);
+  dict_free_index (dt);
+  if (dict_new_index (dt, MINSIZE) == -1)
     return -1;
   dt->dt_used_count = 0;
   dt->dt_active_entries_count = 0;
-  dt->dt_free_count = MIN_NUM_ENT;
+  dt->dt_free_count = USABLE_FRACTION (dt, dt->dt_allocated_count);
+  dt->dt_compacting = false;
   if (array_clear (&dt->dt_entries) != 0)
     {
       return -1;
@@ -1037,42 +2436,72 @@ dict_copy (dict *o)
   if (!o)
     return NULL;
   if (o->dt_active_entries_count == 0)
-    return dict_new_empty ();
+    {
+      dict_config config = { .index_kind = o->dt_index_kind,
+                             .hash_kind = o->dt_hash_kind,
+                             .incremental_resize = o->dt_incremental_resize,
+                             .keep_tombstones = o->dt_keep_tombstones,
+                             .value_kind = dict_value_kind (o),
+                             .allocator = o->dt_alloc,
+                             .max_load = o->dt_max_load,
+                             .growth = o->dt_growth,
+                             .shrink_at = o->dt_shrink_at };
+      return dict_new_configured (0, &config);
+    }
+  dict_rehash_finish (o);
 
   assert (o);
-  dict *new = SAFEMALLOC (sizeof (dict));
-  memcpy (new, o, sizeof (dict));
+  dict *new = DICT_ALLOC (o->dt_alloc, sizeof (dict));
   if (!new)
     {
       return NULL;
     }
+  memcpy (new, o, sizeof (dict));
+#ifdef DICT_STATS
+  memset (&new->dt_stats, 0, sizeof (dict_stats));
+#endif
+  /* none of the arrays of `o` is shared, so they are NULL until copied */
+  new->dt_entries.ar_items = NULL;
+  new->dt_indices = NULL;
+  new->dt_ctrl = NULL;
+  new->dt_values = NULL;
 
   ssize_t keys_size = DT_SIZE (o);
   ssize_t d = dict_new_index (new, keys_size);
   if (d == -1)
-    return NULL;
+    return dict_discard (new, 0);
   memcpy (new->dt_indices, o->dt_indices, d);
-  /* After copying key/value pairs, we need to incref all
-     keysobj and valset and they are about to be co-owned by a
-     new dict object. */
-
-  dt_entry **entries = DT_ENTRIES (o);
-  entry_list *entries_copy = array_create (o->dt_active_entries_count);
+  if (o->dt_ctrl)
+    memcpy (new->dt_ctrl, o->dt_ctrl, keys_size);
+
+  /* The index refers to entries by position, so the entry array (deleted
+     slots included) is copied verbatim. Borrowed values are shared, not
+     duplicated, except for the heap copies of DICT_INLINE_VALUES; owned
+     ones are copied into an arena of the copy's own. */
+  entry_list *entries_copy = array_copy (&o->dt_entries);
   if (!entries_copy)
-    return NULL;
-  entries_copy->ar_isfirst = ~entries_copy->ar_isfirst;
-
-  ssize_t n = o->dt_used_count;
-  for (ssize_t i = 0; i < n; i++)
+    return dict_discard (new, 0);
+  new->dt_entries = *entries_copy;
+  free (entries_copy);
+  if (o->dt_values
+      && !(new->dt_values
+           = value_arena_new (dict_value_kind (o) == VALUES_INTERNED)))
+    return dict_discard (new, 0);
+#ifndef DICT_INLINE_VALUES
+  if (new->dt_values)
+#endif
     {
-      dt_entry *entry = entries[i];
-      dval_t value = entry->et_value;
-      if (value != NULL)
-        {
-          array_append (entries_copy, entry);
-        }
+      dt_entry *entries = DT_ENTRIES (new);
+      for (ssize_t i = 0; i < new->dt_entries.ar_used_count; i++)
+        if (!ENTRY_IS_DELETED (&entries[i])
+            && entry_init_value (new->dt_values, &entries[i],
+                                 ENTRY_VALUE (&DT_ENTRIES (o)[i]))
+                   != 0)
+          {
+            fprintf (stderr, "value copy failed\n");
+            return dict_discard (new, i);
+          }
     }
-  new->dt_entries = *entries_copy;
   assert_consistent (new);
   return new;
 }
@@ -1103,8 +2532,8 @@ key_eq (const dkey_t *self, const dkey_t *other)
 int
 dict_update (dict *a, dict *b, int override)
 {
-  ssize_t i, n;
-  dt_entry **ep0;
+  ssize_t i, n, m;
+  dt_entry *ep0;
   dt_entry *entry;
 
   if (override != 1 && override != 0)
@@ -1121,10 +2550,11 @@ dict_update (dict *a, dict *b, int override)
       return 0;
     }
   // resize index
-  if (USABLE_FRACTION (a->dt_allocated_count)
+  if (USABLE_FRACTION (a, a->dt_allocated_count)
       < b->dt_active_entries_count + a->dt_used_count)
     {
-      if (dict_resize (a, ESTIMATE_SIZE (a->dt_used_count + b->dt_used_count))
+      if (dict_resize (a,
+                       ESTIMATE_SIZE (a, a->dt_used_count + b->dt_used_count))
           != 0)
         {
           return -1;
@@ -1139,16 +2569,21 @@ dict_update (dict *a, dict *b, int override)
       return -1;
     }
   ep0 = DT_ENTRIES (b);
-  for (i = 0, n = b->dt_active_entries_count; i < n; i++)
+  n = b->dt_active_entries_count;
+  for (i = 0, m = b->dt_used_count; i < m; i++)
     {
       dkey_t key;
       dval_t value;
       hash_t hash;
 
-      entry = ep0[i];
+      entry = &ep0[i];
+      if (ENTRY_IS_DELETED (entry))
+        continue;
       key = entry->et_key;
-      hash = entry->et_hashval;
-      value = entry->et_value;
+      /* the stored hash is only reusable if both dicts hash alike */
+      hash = (a->dt_hash_kind == b->dt_hash_kind) ? entry->et_hashval
+                                                  : dict_hash (a, key);
+      value = ENTRY_VALUE (entry);
 
       if (value != NULL)
         {
@@ -1166,7 +2601,7 @@ dict_update (dict *a, dict *b, int override)
                   err = 0;
                 }
             }
-          if (err != 0)
+          if (err != OK && err != OK_REPLACED)
             return -1;
 
           if (n != b->dt_active_entries_count)
@@ -1205,15 +2640,18 @@ dict_equal (dict *a, dict *b)
     return 0;
   for (i = 0; i < a->dt_used_count; i++)
     {
-      dt_entry *ep = DT_ENTRIES (a)[i];
-      dval_t a_val = ep->et_value;
-      if (a_val != NULL)
+      dt_entry *ep = &DT_ENTRIES (a)[i];
+      dval_t a_val = ENTRY_VALUE (ep);
+      if (!ENTRY_IS_DELETED (ep) && a_val != NULL)
         {
           int cmp;
           dval_t b_val;
           dkey_t key = ep->et_key;
 
-          ssize_t er = dict_lookup (b, ep->et_hashval, key, &b_val);
+          hash_t h = (a->dt_hash_kind == b->dt_hash_kind)
+                         ? ep->et_hashval
+                         : dict_hash (b, key);
+          ssize_t er = dict_lookup (b, h, key, &b_val);
           if (b_val == NULL || er == DICT_IS_NULL)
             {
               return 0;
@@ -1239,28 +2677,113 @@ dict_sizeof (dict *dt)
   size_t t = 0;
   /* size of entries */
   t += sizeof (dt->dt_entries);
-  t += (sizeof (dt_entry) * dt->dt_active_entries_count)
-       + (sizeof (dt_entry *) * dt->dt_entries.ar_allocated_count);
+  t += sizeof (dt_entry) * dt->dt_entries.ar_allocated_count;
   t += sizeof (dict);
 
   /* sizeof indices*/
-  ssize_t s = DT_SIZE (dt);
-  assert (IS_POWER_OF_2 (s));
-  int es;
-  if (s <= 0xff)
-    es = 1;
-  else if (s <= 0xffff)
-    es = 2;
-#if SIZEOF_VOID_P > 4
-  else if (s > 0xffffffff)
-    es = 8;
-#endif
-  else
-    es = 4;
-  t += dt->dt_allocated_count * es;
+  assert (IS_POWER_OF_2 (DT_SIZE (dt)));
+  t += dt->dt_allocated_count * dictkeys_index_width (dt);
+  if (dt->dt_ctrl)
+    t += dt->dt_allocated_count;
+  if (IS_REHASHING (dt))
+    {
+      ssize_t old = dt->dt_old_allocated_count;
+      t += old * index_width (old);
+      if (dt->dt_old_ctrl)
+        t += old;
+    }
+  t += value_arena_sizeof (dt->dt_values);
   return (ssize_t)t;
 }
 
+/* the number of probes (slots, or groups for INDEX_SWISS) to reach `ix` */
+static ssize_t
+probe_length (dict *dt, hash_t hash, ssize_t ix)
+{
+  ssize_t n = 1;
+  if (IS_ROBIN_HOOD (dt))
+    return rh_distance (dt, rh_lookdict_index (dt, hash, ix)) + 1;
+  if (IS_SWISS (dt))
+    {
+      size_t g = swiss_first_group (DT_SIZE (dt), hash);
+      for (size_t step = 0;;
+           g = SWISS_NEXT_GROUP (DT_SIZE (dt), g, step), n++)
+        for (unsigned j = 0; j < GROUP_WIDTH; j++)
+          if (dt->dt_ctrl[g * GROUP_WIDTH + j] == SWISS_H2 (hash)
+              && dictkeys_get_index (dt, g * GROUP_WIDTH + j) == ix)
+            return n;
+    }
+  size_t mask = DT_MASK (dt);
+  size_t i = hash & mask;
+  for (size_t perturb = hash; dictkeys_get_index (dt, i) != ix; n++)
+    {
+      perturb >>= PERTURB_SHIFT;
+      i = mask & (i * 5 + perturb + 1);
+    }
+  return n;
+}
+
+double
+dict_mean_probe_length (dict *dt)
+{
+  if (!dt || dt->dt_active_entries_count == 0)
+    return 0.0;
+  dict_rehash_finish (dt);
+  double total = 0;
+  dt_entry *entries = DT_ENTRIES (dt);
+  for (ssize_t ix = 0; ix < dt->dt_used_count; ix++)
+    if (!ENTRY_IS_DELETED (&entries[ix]))
+      total += probe_length (dt, entries[ix].et_hashval, ix);
+  return total / (double)dt->dt_active_entries_count;
+}
+
+int
+dict_get_stats (dict *dt, dict_stats *stats)
+{
+  if (!dt || !stats)
+    {
+      fprintf (stderr, "null pointer\n");
+      return -1;
+    }
+#ifdef DICT_STATS
+  *stats = dt->dt_stats;
+#else
+  memset (stats, 0, sizeof (dict_stats));
+#endif
+  ssize_t used = dt->dt_entries.ar_used_count;
+  stats->st_tombstones = used - dt->dt_active_entries_count;
+  stats->st_tombstone_ratio
+      = used ? (double)stats->st_tombstones / (double)used : 0.0;
+  stats->st_entry_slack = dt->dt_entries.ar_allocated_count - used;
+  return 0;
+}
+
+#ifdef DICT_STATS
+
+/* the mean of a probe length histogram; the last bucket counts as its floor */
+static double
+histogram_mean (const uint64_t *hist)
+{
+  uint64_t n = 0, total = 0;
+  for (int k = 0; k < DICT_PROBE_BUCKETS; k++)
+    {
+      n += hist[k];
+      total += hist[k] * (uint64_t)(k + 1);
+    }
+  return n ? (double)total / (double)n : 0.0;
+}
+
+static void
+print_histogram (const char *name, const uint64_t *hist)
+{
+  printf ("  %-16s: \033[0m\033[33m", name);
+  for (int k = 0; k < DICT_PROBE_BUCKETS; k++)
+    printf ("%" PRIu64 "%s", hist[k], k == DICT_PROBE_BUCKETS - 1 ? "+" : " ");
+  printf ("\033[0m\n");
+}
+
+#endif
+
 void
 dict_printinfo (dict *dt)
 {
@@ -1271,9 +2794,6 @@ dict_printinfo (dict *dt)
       printf ("\033[1m\033[32m--Dictionary Attributes--:\033[0m\n");
       printf ("< size in bytes   : \033[0m\033[33m%zd bytes\033[0m\n",
               dict_sizeof (dt));
-#ifdef PROBES
-      printf ("  avg no. probes  : \033[0m\033[33m%.2f\033[0m\n", average);
-#endif
       printf ("  allocated       : \033[0m\033[33m%zd\033[0m\n",
               dt->dt_allocated_count);
       printf ("  used            : \033[0m\033[34m%zd\033[0m\n",
@@ -1282,6 +2802,24 @@ dict_printinfo (dict *dt)
               dt->dt_active_entries_count);
       printf ("  free            : \033[0m\033[32m%zd\033[0m\n",
               dt->dt_free_count);
+
+      dict_stats stats;
+      dict_get_stats (dt, &stats);
+      printf ("  tombstones      : \033[0m\033[34m%zd (%.1f%%)\033[0m\n",
+              stats.st_tombstones, stats.st_tombstone_ratio * 100);
+      printf ("  entry slack     : \033[0m\033[32m%zd\033[0m\n",
+              stats.st_entry_slack);
+#ifdef DICT_STATS
+      printf ("  resizes         : \033[0m\033[33m%" PRIu64
+              " (%.2f ms)\033[0m\n",
+              stats.st_resizes, stats.st_resize_ms);
+      printf ("  avg hit probes  : \033[0m\033[33m%.2f\033[0m\n",
+              histogram_mean (stats.st_hit_probes));
+      printf ("  avg miss probes : \033[0m\033[33m%.2f\033[0m\n",
+              histogram_mean (stats.st_miss_probes));
+      print_histogram ("hit probes", stats.st_hit_probes);
+      print_histogram ("miss probes", stats.st_miss_probes);
+#endif
       printf ("  load factor     : \033[1m\033[35m%.3f\033[0m />\n",
               ((double)dt->dt_used_count / (double)dt->dt_allocated_count));
     }
@@ -1290,11 +2828,11 @@ dict_printinfo (dict *dt)
 static void
 build_indices_open_addressing_linear (dict *dt, ssize_t n)
 {
-  dt_entry **entries = DT_ENTRIES (dt);
+  dt_entry *entries = DT_ENTRIES (dt);
   size_t mask = DT_MASK (dt);
   for (size_t ix = 0, i = 0; ix < n; ix++)
     {
-      i = entries[i]->et_hashval & mask;
+      i = entries[ix].et_hashval & mask;
       while (dictkeys_get_index (dt, i) != EMPTY)
         i = (i + 1) & mask;
       dictkeys_set_index (dt, i, ix);
@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <string.h>
 
 
 // For systems where SIZEOF_VOID_P is not defined, determine it
@@ -26,6 +27,58 @@ void *safe_realloc(void *p, size_t n, unsigned long line);
 #define SAFEMALLOC(n) safe_malloc(n, __LINE__)
 #define SAFEREALLOC(p, n) safe_realloc(p, n, __LINE__)
 
+/**
+ * @brief Where a dict gets the memory of its struct, index and entries
+ *
+ * Each function is passed da_ctx first. da_realloc and da_free are also
+ * passed the size the block was allocated with, so pool and mmap backed
+ * allocators need not record it. The allocator must outlive the dicts that
+ * use it; dict_copy shares it with the copy.
+ *
+ */
+typedef struct dict_allocator
+{
+        void*   (*da_alloc)(void *ctx, size_t n);
+        void*   (*da_realloc)(void *ctx, void *p, size_t old_n, size_t n);
+        void    (*da_free)(void *ctx, void *p, size_t n);
+        void*   da_ctx;
+} dict_allocator;
+
+/* malloc, realloc and free, reporting failures to stderr */
+extern const dict_allocator dict_malloc_allocator;
+
+#define DICT_ALLOC(a, n) ((a)->da_alloc((a)->da_ctx, n))
+#define DICT_REALLOC(a, p, old_n, n) ((a)->da_realloc((a)->da_ctx, p, old_n, n))
+#define DICT_FREE(a, p, n) ((a)->da_free((a)->da_ctx, p, n))
+
+/* The page size of dict_hugepage_allocator, and its smallest mapping */
+#define DICT_HUGEPAGE_SIZE ((size_t)2 << 20)
+
+/*
+ * Blocks of DICT_HUGEPAGE_SIZE bytes or more, the index and entry arrays of
+ * large tables, are mapped 2 MiB aligned: from MAP_HUGETLB pages when the
+ * system has some reserved, otherwise with madvise(MADV_HUGEPAGE) so that
+ * transparent huge pages back them. Smaller blocks come from malloc.
+ */
+extern const dict_allocator dict_hugepage_allocator;
+
+/**
+ * @brief Counters kept by a counting_allocator
+ *
+ */
+typedef struct alloc_stats
+{
+        size_t                  as_allocs;
+        size_t                  as_reallocs;
+        size_t                  as_frees;
+        size_t                  as_live_bytes;
+        size_t                  as_peak_bytes;
+        const dict_allocator*   as_backing;     // NULL for dict_malloc_allocator
+} alloc_stats;
+
+/* an allocator which counts into `stats` and forwards to its as_backing */
+dict_allocator counting_allocator(alloc_stats *stats);
+
 /* The type of the dictionary key; Currently it is a double  */
 typedef double dkey_t; 
 
@@ -92,14 +145,104 @@ typedef struct valset {
  * struct _item is only used as a return type.
  * 
  */
+#ifdef DICT_INLINE_VALUES
+
+/* The longest value string stored inside its entry */
+#define DICT_INLINE_MAX (22)
+
+/* vs_tag of a value kept on the heap */
+#define DVAL_HEAP ((uint8_t)0xff)
+
+/* vs_tag of a value kept in the dict's value arena (VALUES_OWNED) */
+#define DVAL_ARENA ((uint8_t)0xfe)
+
+/**
+ * @brief The value of an entry when the library is built with
+ * DICT_INLINE_VALUES (cmake -DINLINE_VALUES=ON)
+ *
+ * The dict stores a copy of every value string. Strings of up to
+ * DICT_INLINE_MAX bytes live in vs_chars, NUL terminated, and vs_tag holds
+ * their length. Longer ones are copied to the heap, vs_chars holds the
+ * char * to the copy and vs_tag is DVAL_HEAP; so is a NULL value. A dict
+ * that owns its values copies long ones into its arena (DVAL_ARENA).
+ *
+ * Values returned by lookups then point into the entry array, and are only
+ * valid until the next write to the dict. The copies are the dict's, which
+ * frees them; callers still own the strings they pass in. Readers of an
+ * rcu_dict or sharded_dict may see a value invalidated by a concurrent
+ * write, so those need the default layout.
+ *
+ */
+typedef struct dval_slot
+{
+        char    vs_chars[DICT_INLINE_MAX + 1];
+        uint8_t vs_tag;
+} dval_slot;
+
+/* the string held by `vs` */
+static inline dval_t
+dval_slot_get(const dval_slot *vs)
+{
+        dval_t p;
+        if (vs->vs_tag <= DICT_INLINE_MAX)
+                return (dval_t)vs->vs_chars;
+        memcpy(&p, vs->vs_chars, sizeof(p));
+        return p;
+}
+
+/* store a copy of `v` in `vs`; returns -1 if out of memory */
+static inline int
+dval_slot_set(dval_slot *vs, dval_t v)
+{
+        size_t len = v ? strlen(v) : 0;
+        if (v && len <= DICT_INLINE_MAX) {
+                memcpy(vs->vs_chars, v, len + 1);
+                vs->vs_tag = (uint8_t)len;
+                return 0;
+        }
+        dval_t p = NULL;
+        if (v && !(p = (dval_t)SAFEMALLOC(len + 1)))
+                return -1;
+        if (p)
+                memcpy(p, v, len + 1);
+        memcpy(vs->vs_chars, &p, sizeof(p));
+        vs->vs_tag = DVAL_HEAP;
+        return 0;
+}
+
+/* free the heap copy of the value of `vs`, if it has one */
+static inline void
+dval_slot_release(dval_slot *vs)
+{
+        if (vs->vs_tag == DVAL_HEAP)
+                free(dval_slot_get(vs));
+}
+
+#endif
+
 struct entry
 {
         hash_t et_hashval;
         dkey_t et_key;
+#ifdef DICT_INLINE_VALUES
+        dval_slot et_value;
+#else
         dval_t et_value;
+#endif
 };
 typedef struct entry dt_entry;
 
+/**
+ * @brief Marker stored in `et_hashval` of a deleted entry
+ *
+ * Entries live inline in the entry_list, so a deleted entry cannot be
+ * represented by a NULL pointer. Following CPython, no hash function ever
+ * returns (hash_t)-1, which leaves it free to tag deleted slots.
+ */
+#define DELETED_HASH ((hash_t)-1)
+
+#define ENTRY_IS_DELETED(en) ((en)->et_hashval == DELETED_HASH)
+
 /**
  * @brief A representation of the entry_list of dt_entry values
  * 
@@ -109,15 +252,20 @@ typedef struct entry dt_entry;
  * 
  * ar_items has `ar_allocated_count` total slots.
  * ar_items has `ar_free_count` free slots
+ *
+ * Entries are stored by value, so a lookup that hits an index slot reaches
+ * the entry without an extra pointer dereference. Deleted entries stay in
+ * place, tagged with DELETED_HASH, until the next rebuild.
  * 
  */
 typedef struct entry_list
 {
-        dt_entry**              ar_items;
+        dt_entry*               ar_items;
         ssize_t                 ar_free_count;
         ssize_t                 ar_used_count;           // used = dummies + nentries
         ssize_t                 ar_allocated_count;
-        unsigned short          ar_isfirst;
+        const dict_allocator*   ar_alloc;
+        double                  ar_growth;      // a full array grows by this factor
 } entry_list;
 
 /**
@@ -130,42 +278,210 @@ typedef struct entry_list
  * 
  */
 
+/**
+ * @brief The layout of the hash index of a dictionary
+ *
+ *      1) INDEX_COMPACT: a single int8/16/32/64 array of entry indices,
+ *         probed one slot at a time along the perturb sequence
+ *      2) INDEX_SWISS: the same entry-index array plus one control byte per
+ *         slot holding 7 bits of the hash. Slots are probed 16 at a time
+ *         by comparing a whole group of control bytes at once, so most
+ *         non-matching slots are rejected without touching an entry
+ *      3) INDEX_ROBIN_HOOD: the same entry-index array plus one byte per
+ *         slot holding its probe distance. Slots are probed linearly and an
+ *         insert takes the slot of any entry closer to its home. Deletes
+ *         shift the rest of the run back, so the index has no tombstones
+ *      4) INDEX_TAGGED: INDEX_COMPACT plus one byte per slot holding 8
+ *         other bits of the hash. A full slot whose tag differs from the
+ *         key's is skipped without reading its entry, which saves a cache
+ *         miss per collision on miss-heavy lookups at high load
+ *
+ */
+typedef enum {
+        INDEX_COMPACT,
+        INDEX_SWISS,
+        INDEX_ROBIN_HOOD,
+        INDEX_TAGGED,
+} index_kind_t;
+
+/**
+ * @brief The hash function applied to the keys of a dictionary
+ *
+ *      1) HASH_DOUBLE: CPython's numeric hash (hash_double). Integral
+ *         doubles hash to themselves, so the low bits are highly structured
+ *      2) HASH_FAST: the raw IEEE-754 bits through a 64 bit mixer
+ *         (hash_double_fast)
+ *
+ */
+typedef enum {
+        HASH_DOUBLE,
+        HASH_FAST,
+} hash_kind_t;
+
+/* The hash used by dictionaries not created through dict_new_configured */
+#ifndef DICT_DEFAULT_HASH
+#define DICT_DEFAULT_HASH HASH_DOUBLE
+#endif
+
+/**
+ * @brief Who owns the value strings of a dictionary
+ *
+ *      1) VALUES_BORROWED: the caller; the dict stores the pointers it is
+ *         given, and they must outlive it
+ *      2) VALUES_OWNED: the dict, which copies each value into a bump
+ *         pointer arena of its own (value_arena.h). dict_free and
+ *         dict_clear free them all at once, and a resize compacts the arena
+ *         once half of it holds overwritten or deleted values. Values read
+ *         from the dict are valid until its next write
+ *      3) VALUES_INTERNED: VALUES_OWNED, storing equal values only once
+ *
+ */
+typedef enum {
+        VALUES_BORROWED,
+        VALUES_OWNED,
+        VALUES_INTERNED,
+} value_kind_t;
+
+struct value_arena;
+
+/* The sizing policy of dicts whose dict_config leaves it at 0 */
+#define DICT_DEFAULT_MAX_LOAD (2.0 / 3.0)
+#define DICT_DEFAULT_GROWTH (2.0)
+#define DICT_DEFAULT_SHRINK_AT (0.5)
+#define DICT_DEFAULT_ENTRY_GROWTH (1.5)
+
+/**
+ * @brief Creation time settings of a dictionary
+ *
+ * The sizing policy fields are 0 for the defaults above:
+ *
+ *      1) max_load: the share of its index slots a dict fills before it
+ *         resizes, in (0, 1). A higher load takes fewer bytes per entry and
+ *         longer probes
+ *      2) growth: a resized index has room for `growth` times the live
+ *         entries, more than 1. Index sizes are powers of 2, so the index
+ *         grows to the next one that fits. When set, the entry array also
+ *         grows by this factor, but never by less than
+ *         DICT_DEFAULT_ENTRY_GROWTH
+ *      3) shrink_at: the share of tombstones among the used entries at
+ *         which a delete starts compacting the dict, in (0, 1]
+ *
+ * dict_new_configured returns NULL for values out of range.
+ */
+typedef struct dict_config
+{
+        index_kind_t    index_kind;
+        hash_kind_t     hash_kind;
+        bool            incremental_resize;     // spread index rebuilds over later writes
+        bool            keep_tombstones;        // never compact on delete (see dict)
+        value_kind_t    value_kind;
+        const dict_allocator*   allocator;      // NULL for dict_malloc_allocator
+        double          max_load;
+        double          growth;
+        double          shrink_at;
+} dict_config;
+
+/* Probe lengths of DICT_PROBE_BUCKETS or more share the last bucket */
+#define DICT_PROBE_BUCKETS (16)
+
+/**
+ * @brief Statistics about a dictionary, filled in by dict_get_stats
+ *
+ * The probe histograms and resize counters are only collected when the
+ * library is built with DICT_STATS (cmake -DDICT_STATS=ON). Otherwise the
+ * counting compiles to nothing and they read as zero. Counting is not
+ * atomic, so lookups racing on one dict (rcu_dict) may lose counts.
+ *
+ * A probe is one index slot, or one group of slots for INDEX_SWISS.
+ * st_hit_probes[k] is the number of successful lookups which took k + 1
+ * probes, st_miss_probes[k] the same for unsuccessful ones. Inserts count
+ * their lookup for the key.
+ *
+ */
+typedef struct dict_stats
+{
+        uint64_t        st_hit_probes[DICT_PROBE_BUCKETS];
+        uint64_t        st_miss_probes[DICT_PROBE_BUCKETS];
+        uint64_t        st_resizes;             // index rebuilds, incremental ones included
+        double          st_resize_ms;           // time spent in them
+        ssize_t         st_tombstones;          // deleted entries still in the entry array
+        double          st_tombstone_ratio;     // tombstones / used entry slots
+        ssize_t         st_entry_slack;         // allocated but unused entry slots
+} dict_stats;
+
 typedef struct dict
 {
-        entry_list   dt_entries;        // entries in order
-        void*        dt_indices;        // indices
-        ssize_t      dt_free_count;           // frees
-        ssize_t      dt_active_entries_count;       // active entries
-        ssize_t      dt_allocated_count;      // all of it
-        ssize_t      dt_used_count;           // active + dummies
+        entry_list      dt_entries;        // entries in order
+        void*           dt_indices;        // indices
+        uint8_t*        dt_ctrl;           // control bytes (INDEX_SWISS), probe distances (INDEX_ROBIN_HOOD) or tags (INDEX_TAGGED)
+        ssize_t         dt_free_count;           // frees
+        ssize_t         dt_active_entries_count;       // active entries
+        ssize_t         dt_allocated_count;      // all of it
+        ssize_t         dt_used_count;           // active + dummies
+        index_kind_t    dt_index_kind;
+        hash_kind_t     dt_hash_kind;
+        double          dt_max_load;            // the sizing policy of dict_config
+        double          dt_growth;
+        double          dt_shrink_at;
+        struct value_arena*     dt_values;      // owned values, NULL if borrowed
+        const dict_allocator*   dt_alloc;       // of the dict, its index and entries
+
+        /* incremental resizing: while dt_old_indices is set, the entries in
+         * [dt_rehash_pos, dt_rehash_end) are still only indexed by it */
+        bool            dt_incremental_resize;
+        void*           dt_old_indices;
+        uint8_t*        dt_old_ctrl;
+        ssize_t         dt_old_allocated_count;
+        ssize_t         dt_rehash_pos;
+        ssize_t         dt_rehash_end;
+
+        /* compaction: once a share dt_shrink_at of the used entries is
+         * deleted, later writes slide the live ones in
+         * [dt_compact_from, dt_used_count) down to dt_compact_to, a few
+         * positions at a time, then rebuild the index incrementally at a
+         * size fit for what is left */
+        bool            dt_keep_tombstones;
+        bool            dt_compacting;
+        ssize_t         dt_compact_from;
+        ssize_t         dt_compact_to;
+#ifdef DICT_STATS
+        dict_stats      dt_stats;
+#endif
 } dict;
 
-enum {
+typedef enum {
   OK,
   OK_REPLACED,
   INVALID_INPUT,
   INTERNAL_ERROR
 } InsertResultStatus;
 
-entry_list *array_create(size_t initial_size);
+/* an array of room for `initial_size` entries that grows by `growth`, or
+   DICT_DEFAULT_ENTRY_GROWTH if that is more */
+entry_list *array_create(size_t initial_size, double growth,
+                         const dict_allocator *alloc);
+
+/* array_create into `arr`; -1 if out of memory */
+int array_init(entry_list *arr, size_t initial_size, double growth,
+               const dict_allocator *alloc);
 
 ssize_t array_lookup(entry_list *arr, dt_entry *en);
 
-int array_append(entry_list *arr, dt_entry *item);
+int array_append(entry_list *arr, const dt_entry *item);
 
-void array_insert(entry_list *arr, ssize_t index, dt_entry *item);
+void array_insert(entry_list *arr, ssize_t index, const dt_entry *item);
 
 void array_delete(entry_list *arr, ssize_t index);
 
 dt_entry array_pop(entry_list *arr);
 
-int array_extend(entry_list *arr, dt_entry **ens, ssize_t nd);
+int array_extend(entry_list *arr, const dt_entry *ens, ssize_t nd);
 
 dt_entry *array_getitem(entry_list *arr, ssize_t ix);
 
-void array_free(entry_list *arr);
+entry_list *array_copy(const entry_list *arr);
 
-static int array_setitem(entry_list *arr, ssize_t ix, dt_entry *entry);
+void array_free(entry_list *arr);
 
 void array_free_items(entry_list *arr);
 
@@ -173,6 +489,9 @@ int arr_remove_entry(entry_list *arr, ssize_t ix);
 
 int array_grow(entry_list *arr, ssize_t n);
 
+/* give back the storage of an array that is at most half full */
+int array_shrink(entry_list *arr);
+
 int array_clear(entry_list *arr);
 
 ssize_t array_size(entry_list *arr);
@@ -181,6 +500,14 @@ ssize_t array_size(entry_list *arr);
 // return hash(key)
 hash_t hash(dkey_t key);
 
+/**
+ * @brief The hash of `key` under the hash function of `dt`
+ *
+ * This is the hash to pass to dict_insert_with_hash, dict_lookup and
+ * dict_getvalue_knownhash.
+ */
+hash_t dict_hash(const dict *dt, dkey_t key);
+
 /**
  * @brief create a new empty dictionary with no entries and MINSIZE total slots
  * 
@@ -189,9 +516,43 @@ hash_t hash(dkey_t key);
 dict*
 dict_new_empty(void);
 
+/**
+ * @brief create a dictionary holding keys[i] -> values[i]
+ *
+ * The entries are laid out and indexed in one pass. If a key repeats, it
+ * keeps its first position and the value of its last occurrence.
+ *
+ * @return dict*
+ */
 dict*
 dict_new_initialized(dkey_t *keys, dval_t *values, size_t n);
 
+/**
+ * @brief dict_new_initialized, hashing the keys on up to `nthreads` threads
+ *
+ * @return dict*
+ */
+dict*
+dict_new_initialized_parallel(dkey_t *keys, dval_t *values, size_t n, int nthreads);
+
+/**
+ * @brief create a new empty dictionary able to hold `nentries` entries
+ * without resizing, whose hash index uses the layout `kind`
+ *
+ * @return dict*
+ */
+dict*
+dict_new_with_index(size_t nentries, index_kind_t kind);
+
+/**
+ * @brief create a new empty dictionary able to hold `nentries` entries
+ * without resizing, set up as described by `config`
+ *
+ * @return dict*
+ */
+dict*
+dict_new_configured(size_t nentries, const dict_config *config);
+
 int
 dict_contains(dict *dict, dkey_t key);
 
@@ -208,6 +569,15 @@ static void dict_print(dict *dt) {
 
 }
 
+/**
+ * @brief remove `key`
+ *
+ * The entry and its index slot become tombstones. Once the share of
+ * tombstones among the used entries of a dict reaches its shrink_at, a
+ * delete starts compacting it unless it was configured with keep_tombstones.
+ *
+ * @return int (0) if it was removed, (-1) if it was absent
+ */
 int
 dict_delitem(dict *dt, dkey_t key);
 
@@ -215,6 +585,28 @@ int dict_insert_with_hash(dict *dt, hash_t hash, const dkey_t *key, const dval_t
 
 int dict_insert(dict *dt, dkey_t key, dval_t value);
 
+/* The new value of `key` given its current one, NONE (NULL) if it is
+   absent; it must not modify the dict it is called for. Returning NONE
+   leaves the dict as it was: values are never NULL */
+typedef dval_t (*dict_upsert_fn)(dkey_t key, dval_t old, void *ctx);
+
+/**
+ * @brief Insert `key`, or update its value, with what `fn` returns
+ *
+ * The key is looked up and, if absent, inserted in a single walk of the
+ * probe sequence, so a read-modify-write is one probe instead of the
+ * lookup plus insert of dict_getvalue and dict_insert.
+ *
+ * @return int OK if the key was inserted, OK_REPLACED if it was updated,
+ *             INVALID_INPUT if `fn` returned NONE, which inserts or
+ *             updates nothing, or INTERNAL_ERROR
+ */
+int dict_upsert(dict *dt, dkey_t key, dict_upsert_fn fn, void *ctx);
+
+/* the value of `key`, inserting it with `value` first if it is absent;
+   NULL if out of memory, or if `value` is NULL and the key is absent */
+dval_t dict_setdefault(dict *dt, dkey_t key, dval_t value);
+
 ssize_t dict_lookup(dict *dt, hash_t h, dkey_t key, volatile dval_t *value);
 
 void print_indices(dict *dt);
@@ -249,6 +641,20 @@ int dict_equal(dict *a, dict *b);
 
 void dict_printinfo(dict *dt);
 
+/**
+ * @brief The mean number of index probes needed to find an active entry
+ *
+ * For an INDEX_SWISS dict this counts control-byte groups, not slots.
+ */
+double dict_mean_probe_length(dict *dt);
+
+/**
+ * @brief Report the statistics of `dt` in `stats`
+ *
+ * @return int (0) on success, (-1) if either pointer is NULL
+ */
+int dict_get_stats(dict *dt, dict_stats *stats);
+
 /**
  * @brief The total number of active entries in the dictionary
  * 
@@ -260,6 +666,9 @@ void dict_printinfo(dict *dt);
  */
 ssize_t dict_size(dict *dt);
 
+/* the bytes taken by `dt`: entries, index and, if it owns them, values */
+ssize_t dict_sizeof(dict *dt);
+
 int dict_is_empty(dict *dt);
 
 int dict_clear(dict *dt);
@@ -268,6 +677,22 @@ dval_t dict_getvalue(dict *dt, dkey_t key);
 
 dval_t dict_getvalue_knownhash(dict *dt, hash_t h, dkey_t key);
 
+/**
+ * @brief Look up `n` keys at once, overlapping their cache misses
+ *
+ * values[i] is set to the value of keys[i], or NULL if it is absent.
+ *
+ * @return ssize_t the number of keys found, or -1 on invalid input
+ */
+ssize_t dict_lookup_batch(dict *dt, const dkey_t *keys, ssize_t n, dval_t *values);
+
+/**
+ * @brief Batched dict_contains; found[i] is set iff keys[i] is in `dt`
+ *
+ * @return ssize_t the number of keys found, or -1 on invalid input
+ */
+ssize_t dict_contains_batch(dict *dt, const dkey_t *keys, ssize_t n, bool *found);
+
 int dict_getitem(dict *dt, dkey_t key, item *it);
 
 dict* dict_new_presized(size_t nentries);
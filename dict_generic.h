@@ -0,0 +1,414 @@
+//
+// Dicts over arbitrary key and value types, instantiated by macros
+//
+
+#ifndef HASHTABLE_DICT_GENERIC_H
+#define HASHTABLE_DICT_GENERIC_H
+
+#include <string.h>
+
+#include "dict.h"
+
+/*
+ * DICT_DECLARE(name, K, V) declares the type `name` and its functions;
+ * put it in a header. DICT_DEFINE(name, K, V, hash, eq) defines them, in
+ * exactly one translation unit:
+ *
+ *   hash_t point_hash (struct point p);
+ *   int point_eq (struct point a, struct point b);
+ *
+ *   DICT_DECLARE (point_dict, struct point, double)
+ *   DICT_DEFINE (point_dict, struct point, double, point_hash, point_eq)
+ *
+ *   point_dict *pd = point_dict_new (0);
+ *   point_dict_insert (pd, p, 1.5);
+ *   double *v = point_dict_get (pd, p);
+ *
+ * `hash` and `eq` take keys by value and are called directly, so the
+ * compiler can inline them into the probe loops. Keys and values are
+ * copied into the entries; the dict never frees anything they point to.
+ *
+ * The layout is that of dict: entries in insertion order plus a compact
+ * int8/16/32/64 index probed along the perturb sequence, so a weak `hash`
+ * is tolerated. A resize drops deleted entries. The generated code is
+ * valid C and C++, so C++ callers may instantiate it too.
+ *
+ * As in dict, the probe loops are generated once per index width
+ * (GD_DEFINE_PROBES) and GD_BY_WIDTH picks one per call, so no probe
+ * switches on the width.
+ *
+ * Dicts that need more than DICT_DEFINE offers (str_dict keeps its keys in
+ * an arena) declare the same layout with GD_DECLARE_TYPES and build on
+ * GD_DEFINE_ALLOC and GD_DEFINE_PROBES directly.
+ */
+
+/* index slot states; full slots hold the position of their entry */
+#define GD_EMPTY (-1)
+#define GD_DUMMY (-2)
+
+#define GD_PERTURB_SHIFT ((unsigned)5)
+
+#define GD_USABLE_FRACTION(n) (((n) << 1) / 3)
+
+#define GD_ESTIMATE_SIZE(n) (((((n)*3) + 1)) >> 1)
+
+static inline ssize_t
+gd_get_index (const void *indices, int width, size_t i)
+{
+  switch (width)
+    {
+    case 1:
+      return ((const int8_t *)indices)[i];
+    case 2:
+      return ((const int16_t *)indices)[i];
+    case 4:
+      return ((const int32_t *)indices)[i];
+    default:
+      return ((const int64_t *)indices)[i];
+    }
+}
+
+static inline void
+gd_set_index (void *indices, int width, size_t i, ssize_t ix)
+{
+  switch (width)
+    {
+    case 1:
+      ((int8_t *)indices)[i] = (int8_t)ix;
+      break;
+    case 2:
+      ((int16_t *)indices)[i] = (int16_t)ix;
+      break;
+    case 4:
+      ((int32_t *)indices)[i] = (int32_t)ix;
+      break;
+    default:
+      ((int64_t *)indices)[i] = ix;
+    }
+}
+
+/* the smallest power of 2 that is at least `minsize` and MINSIZE */
+static inline ssize_t
+gd_index_size (ssize_t minsize)
+{
+  ssize_t s = MINSIZE;
+  while (s < minsize)
+    s <<= 1;
+  return s;
+}
+
+/* bytes per slot of an index of `s` slots */
+static inline int
+gd_index_width (ssize_t s)
+{
+  return (s <= 0xff) ? 1 : (s <= 0xffff) ? 2 : (s <= 0xffffffff) ? 4 : 8;
+}
+
+/* fn##_8 (...) to fn##_64 (...), whichever matches the index width of `d` */
+#define GD_BY_WIDTH(d, fn, ...)                                               \
+  ((d)->gd_index_width == 1   ? fn##_8 (__VA_ARGS__)                          \
+   : (d)->gd_index_width == 2 ? fn##_16 (__VA_ARGS__)                         \
+   : (d)->gd_index_width == 4 ? fn##_32 (__VA_ARGS__)                         \
+                              : fn##_64 (__VA_ARGS__))
+
+/* `name##_alloc (d, minsize)`: allocate an empty index of at least
+   `minsize` slots and room for as many entries as it holds, 0 or -1. The
+   old arrays are left alone. */
+#define GD_DEFINE_ALLOC(name)                                                 \
+  static int name##_alloc (name *d, ssize_t minsize)                          \
+  {                                                                           \
+    ssize_t s = gd_index_size (minsize);                                      \
+    int width = gd_index_width (s);                                           \
+    void *indices = SAFEMALLOC (width * s);                                   \
+    name##_entry *entries = (name##_entry *)SAFEMALLOC (                      \
+        sizeof (name##_entry) * GD_USABLE_FRACTION (s));                      \
+    if (!indices || !entries)                                                 \
+      {                                                                       \
+        free (indices);                                                       \
+        free (entries);                                                       \
+        return -1;                                                            \
+      }                                                                       \
+    /* GD_EMPTY is all ones at every width */                                 \
+    memset (indices, 0xff, width * s);                                        \
+    d->gd_indices = indices;                                                  \
+    d->gd_entries = entries;                                                  \
+    d->gd_allocated_count = s;                                                \
+    d->gd_index_width = width;                                                \
+    return 0;                                                                 \
+  }
+
+/*
+ * The probe loops of a GD_DECLARE_TYPES `name` for an index of W bit
+ * slots, read as an array of T. Lookups call eq (stored key, key) on
+ * entries with a matching hash; `key` is a K, which need not be the type
+ * of the stored keys. perturb is unsigned, so its shifts reach 0 and every
+ * slot is eventually probed.
+ */
+#define GD_DEFINE_PROBES(name, K, eq, W, T)                                   \
+  /* the position of the entry of `key`, or GD_EMPTY */                       \
+  static inline ssize_t name##_lookup_##W (const name *d, hash_t h, K key)    \
+  {                                                                           \
+    const T *indices = (const T *)d->gd_indices;                              \
+    size_t mask = (size_t)d->gd_allocated_count - 1;                          \
+    size_t i = h & mask;                                                      \
+    for (size_t perturb = h;;)                                                \
+      {                                                                       \
+        ssize_t ix = indices[i];                                              \
+        if (ix == GD_EMPTY)                                                   \
+          return GD_EMPTY;                                                    \
+        if (ix >= 0 && d->gd_entries[ix].ge_hashval == h                      \
+            && eq (d->gd_entries[ix].ge_key, key))                            \
+          return ix;                                                          \
+        perturb >>= GD_PERTURB_SHIFT;                                         \
+        i = mask & (i * 5 + perturb + 1);                                     \
+      }                                                                       \
+  }                                                                           \
+                                                                              \
+  /* the first empty or dummy slot along the probe sequence of `h` */         \
+  static inline size_t name##_find_empty_slot_##W (const name *d, hash_t h)   \
+  {                                                                           \
+    const T *indices = (const T *)d->gd_indices;                              \
+    size_t mask = (size_t)d->gd_allocated_count - 1;                          \
+    size_t i = h & mask;                                                      \
+    for (size_t perturb = h; indices[i] >= 0;)                                \
+      {                                                                       \
+        perturb >>= GD_PERTURB_SHIFT;                                         \
+        i = mask & (i * 5 + perturb + 1);                                     \
+      }                                                                       \
+    return i;                                                                 \
+  }                                                                           \
+                                                                              \
+  /* the slot along the probe sequence of `h` that holds entry `ix` */        \
+  static inline size_t name##_find_index_##W (const name *d, hash_t h,        \
+                                              ssize_t ix)                     \
+  {                                                                           \
+    const T *indices = (const T *)d->gd_indices;                              \
+    size_t mask = (size_t)d->gd_allocated_count - 1;                          \
+    size_t i = h & mask;                                                      \
+    for (size_t perturb = h; indices[i] != ix;)                               \
+      {                                                                       \
+        perturb >>= GD_PERTURB_SHIFT;                                         \
+        i = mask & (i * 5 + perturb + 1);                                     \
+      }                                                                       \
+    return i;                                                                 \
+  }                                                                           \
+                                                                              \
+  /* index the first `n` entries, none of them deleted, in an empty index */  \
+  static void name##_build_##W (name *d, ssize_t n)                           \
+  {                                                                           \
+    T *indices = (T *)d->gd_indices;                                          \
+    size_t mask = (size_t)d->gd_allocated_count - 1;                          \
+    for (ssize_t ix = 0; ix < n; ix++)                                        \
+      {                                                                       \
+        hash_t h = d->gd_entries[ix].ge_hashval;                              \
+        size_t i = h & mask;                                                  \
+        for (size_t perturb = h; indices[i] != GD_EMPTY;)                     \
+          {                                                                   \
+            perturb >>= GD_PERTURB_SHIFT;                                     \
+            i = mask & (i * 5 + perturb + 1);                                 \
+          }                                                                   \
+        indices[i] = (T)ix;                                                   \
+      }                                                                       \
+  }
+
+/* the entry and dict types `name##_entry` and `name` of DICT_DECLARE */
+#define GD_DECLARE_TYPES(name, K, V)                                          \
+  typedef struct name##_entry                                                 \
+  {                                                                           \
+    hash_t ge_hashval; /* DELETED_HASH once deleted */                        \
+    K ge_key;                                                                 \
+    V ge_value;                                                               \
+  } name##_entry;                                                             \
+                                                                              \
+  typedef struct name                                                         \
+  {                                                                           \
+    name##_entry *gd_entries;                                                 \
+    void *gd_indices;                                                         \
+    ssize_t gd_allocated_count; /* index slots, a power of 2 */               \
+    int gd_index_width;         /* bytes per index slot */                    \
+    ssize_t gd_used_count;      /* entries, deleted ones included */          \
+    ssize_t gd_active_count;                                                  \
+    ssize_t gd_free_count; /* entries that fit before a resize */             \
+  } name;
+
+#define DICT_DECLARE(name, K, V)                                              \
+  GD_DECLARE_TYPES (name, K, V)                                               \
+                                                                              \
+  /* a dict that holds `nentries` keys without resizing, or NULL */           \
+  name *name##_new (size_t nentries);                                         \
+  int name##_free (name *d);                                                  \
+  /* OK, OK_REPLACED, or INVALID_INPUT / INTERNAL_ERROR */                    \
+  int name##_insert (name *d, K key, V value);                                \
+  /* the value of `key`, valid until the next insert, or NULL */              \
+  V *name##_get (name *d, K key);                                             \
+  int name##_contains (name *d, K key);                                       \
+  /* (0) if `key` was removed, (-1) if it was absent */                       \
+  int name##_delitem (name *d, K key);                                        \
+  ssize_t name##_size (name *d);                                              \
+  int name##_clear (name *d);                                                 \
+  /* the live entry at or after *pos in insertion order, or NULL */           \
+  name##_entry *name##_next (name *d, ssize_t *pos);
+
+#define DICT_DEFINE(name, K, V, hash, eq)                                     \
+  static inline hash_t name##_hash (K key)                                    \
+  {                                                                           \
+    hash_t h = hash (key);                                                    \
+    return (h == DELETED_HASH) ? DELETED_HASH - 1 : h;                        \
+  }                                                                           \
+                                                                              \
+  GD_DEFINE_ALLOC (name)                                                      \
+                                                                              \
+  name *name##_new (size_t nentries)                                          \
+  {                                                                           \
+    name *d = (name *)SAFEMALLOC (sizeof (name));                             \
+    if (!d)                                                                   \
+      return NULL;                                                            \
+    memset (d, 0, sizeof (name));                                             \
+    if (name##_alloc (d, GD_ESTIMATE_SIZE ((ssize_t)nentries)) != 0)          \
+      {                                                                       \
+        free (d);                                                             \
+        return NULL;                                                          \
+      }                                                                       \
+    d->gd_free_count = GD_USABLE_FRACTION (d->gd_allocated_count);            \
+    return d;                                                                 \
+  }                                                                           \
+                                                                              \
+  int name##_free (name *d)                                                   \
+  {                                                                           \
+    if (!d)                                                                   \
+      {                                                                       \
+        fprintf (stderr, "NULL POINTER\n");                                   \
+        return -1;                                                            \
+      }                                                                       \
+    free (d->gd_indices);                                                     \
+    free (d->gd_entries);                                                     \
+    free (d);                                                                 \
+    return 1;                                                                 \
+  }                                                                           \
+                                                                              \
+  GD_DEFINE_PROBES (name, K, eq, 8, int8_t)                                   \
+  GD_DEFINE_PROBES (name, K, eq, 16, int16_t)                                 \
+  GD_DEFINE_PROBES (name, K, eq, 32, int32_t)                                 \
+  GD_DEFINE_PROBES (name, K, eq, 64, int64_t)                                 \
+                                                                              \
+  static inline ssize_t name##_lookup (const name *d, hash_t h, K key)        \
+  {                                                                           \
+    return GD_BY_WIDTH (d, name##_lookup, d, h, key);                         \
+  }                                                                           \
+                                                                              \
+  /* rebuild for at least `minsize` slots, dropping the deleted entries */    \
+  static int name##_resize (name *d, ssize_t minsize)                         \
+  {                                                                           \
+    name##_entry *old_entries = d->gd_entries;                                \
+    void *old_indices = d->gd_indices;                                        \
+    ssize_t old_used = d->gd_used_count;                                      \
+    if (name##_alloc (d, minsize) != 0)                                       \
+      return -1;                                                              \
+    ssize_t used = 0;                                                         \
+    for (ssize_t j = 0; j < old_used; j++)                                    \
+      {                                                                       \
+        if (old_entries[j].ge_hashval != DELETED_HASH)                        \
+          d->gd_entries[used++] = old_entries[j];                             \
+      }                                                                       \
+    GD_BY_WIDTH (d, name##_build, d, used);                                   \
+    free (old_entries);                                                       \
+    free (old_indices);                                                       \
+    d->gd_used_count = used;                                                  \
+    d->gd_free_count = GD_USABLE_FRACTION (d->gd_allocated_count) - used;     \
+    return 0;                                                                 \
+  }                                                                           \
+                                                                              \
+  int name##_insert (name *d, K key, V value)                                 \
+  {                                                                           \
+    if (!d)                                                                   \
+      return INVALID_INPUT;                                                   \
+    hash_t h = name##_hash (key);                                             \
+    ssize_t ix = name##_lookup (d, h, key);                                   \
+    if (ix >= 0)                                                              \
+      {                                                                       \
+        d->gd_entries[ix].ge_value = value;                                   \
+        return OK_REPLACED;                                                   \
+      }                                                                       \
+    if (d->gd_free_count <= 0                                                 \
+        && name##_resize (d, d->gd_active_count * 3) != 0)                    \
+      return INTERNAL_ERROR;                                                  \
+    name##_entry *en = &d->gd_entries[d->gd_used_count];                      \
+    en->ge_hashval = h;                                                       \
+    en->ge_key = key;                                                         \
+    en->ge_value = value;                                                     \
+    gd_set_index (d->gd_indices, d->gd_index_width,                           \
+                  GD_BY_WIDTH (d, name##_find_empty_slot, d, h),              \
+                  d->gd_used_count);                                          \
+    d->gd_used_count++;                                                       \
+    d->gd_active_count++;                                                     \
+    d->gd_free_count--;                                                       \
+    return OK;                                                                \
+  }                                                                           \
+                                                                              \
+  V *name##_get (name *d, K key)                                              \
+  {                                                                           \
+    if (!d)                                                                   \
+      {                                                                       \
+        fprintf (stderr, "null pointer\n");                                   \
+        return NULL;                                                          \
+      }                                                                       \
+    ssize_t ix = name##_lookup (d, name##_hash (key), key);                   \
+    return (ix >= 0) ? &d->gd_entries[ix].ge_value : NULL;                    \
+  }                                                                           \
+                                                                              \
+  int name##_contains (name *d, K key)                                        \
+  {                                                                           \
+    if (!d)                                                                   \
+      return -1;                                                              \
+    return name##_lookup (d, name##_hash (key), key) >= 0;                    \
+  }                                                                           \
+                                                                              \
+  int name##_delitem (name *d, K key)                                         \
+  {                                                                           \
+    if (!d)                                                                   \
+      return -1;                                                              \
+    hash_t h = name##_hash (key);                                             \
+    ssize_t ix = name##_lookup (d, h, key);                                   \
+    if (ix < 0)                                                               \
+      return -1;                                                              \
+    gd_set_index (d->gd_indices, d->gd_index_width,                           \
+                  GD_BY_WIDTH (d, name##_find_index, d, h, ix), GD_DUMMY);    \
+    d->gd_entries[ix].ge_hashval = DELETED_HASH;                              \
+    d->gd_active_count--;                                                     \
+    return 0;                                                                 \
+  }                                                                           \
+                                                                              \
+  ssize_t name##_size (name *d)                                               \
+  {                                                                           \
+    if (!d)                                                                   \
+      {                                                                       \
+        fprintf (stderr, "Error\n");                                          \
+        return -1;                                                            \
+      }                                                                       \
+    return d->gd_active_count;                                                \
+  }                                                                           \
+                                                                              \
+  int name##_clear (name *d)                                                  \
+  {                                                                           \
+    if (!d)                                                                   \
+      return -1;                                                              \
+    free (d->gd_indices);                                                     \
+    free (d->gd_entries);                                                     \
+    memset (d, 0, sizeof (name));                                             \
+    if (name##_alloc (d, MINSIZE) != 0)                                       \
+      return -1;                                                              \
+    d->gd_free_count = GD_USABLE_FRACTION (d->gd_allocated_count);            \
+    return 0;                                                                 \
+  }                                                                           \
+                                                                              \
+  name##_entry *name##_next (name *d, ssize_t *pos)                           \
+  {                                                                           \
+    for (; *pos < d->gd_used_count; (*pos)++)                                 \
+      {                                                                       \
+        if (d->gd_entries[*pos].ge_hashval != DELETED_HASH)                   \
+          return &d->gd_entries[(*pos)++];                                    \
+      }                                                                       \
+    return NULL;                                                              \
+  }
+
+#endif //HASHTABLE_DICT_GENERIC_H
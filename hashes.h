@@ -6,14 +6,16 @@
 #define HASHTABLE_HASHES_H
 
 #include <math.h>
+#include <string.h>
 
-hash_t hash_int(dkey_t key)
+static inline hash_t
+hash_int(dkey_t key)
 {
         return (key == -1) ? -2: key;
 
 }
 
-hash_t
+static inline hash_t
 hash_raw_pointer(const void *p)
 {
         size_t y = (size_t) p;
@@ -23,7 +25,8 @@ hash_raw_pointer(const void *p)
         return (hash_t) y;
 }
 
-hash_t dbj2(unsigned char *str)
+static inline hash_t
+dbj2(unsigned char *str)
 {
         hash_t hash = 5381;
         int c;
@@ -34,7 +37,8 @@ hash_t dbj2(unsigned char *str)
         return hash;
 }
 
-hash_t java_hash(unsigned char *str, unsigned int n)
+static inline hash_t
+java_hash(unsigned char *str, unsigned int n)
 {
         hash_t t = 0;
         unsigned int c, i = 1;
@@ -43,7 +47,7 @@ hash_t java_hash(unsigned char *str, unsigned int n)
         return t;
 }
 
-hash_t
+static inline hash_t
 hash_pointer(const void *p)
 {
         hash_t x = hash_raw_pointer(p);
@@ -75,7 +79,7 @@ hash_pointer(const void *p)
         #define IS_FINITE(X) isfinite(X)
 #endif
 
-hash_t
+static inline hash_t
 hash_double(double v)
 {
         int e, sign;
@@ -121,8 +125,138 @@ hash_double(double v)
         return (hash_t)x;
 }
 
-hash_t hash(dkey_t key) {
-        return hash_double(key);
+/*
+ * A fast alternative to hash_double: the raw IEEE-754 bits run through the
+ * murmur3 64 bit finalizer. -0.0 hashes like +0.0 and every NaN like the
+ * canonical quiet NaN, so keys that compare equal hash equal. The bits are
+ * normalized directly since -ffast-math may fold floating point tests away.
+ */
+static inline hash_t
+hash_double_fast(double v)
+{
+        uint64_t x;
+        memcpy(&x, &v, sizeof(x));
+
+        if ((x << 1) == 0)
+                x = 0;
+        else if ((x & 0x7ff0000000000000ull) == 0x7ff0000000000000ull
+                 && (x & 0x000fffffffffffffull))
+                x = 0x7ff8000000000000ull;
+
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+
+        if (x == (hash_t)-1)
+                x = (hash_t)-2;
+        return (hash_t)x;
+}
+
+/*
+ * Fibonacci hashing for integer keys: a multiplication by 2^64 / phi. The
+ * map is a bijection, and the high bits of the product depend on every bit
+ * of the key, so tables should take their slot from the high bits.
+ */
+static inline hash_t
+hash_int64(int64_t key)
+{
+        hash_t x = (hash_t)key * 0x9E3779B97F4A7C15ull;
+        return (x == (hash_t)-1) ? (hash_t)-2 : x;
+}
+
+/* the 128 bit product of *a and *b, low half in *a and high half in *b */
+static inline void
+wymum(uint64_t *a, uint64_t *b)
+{
+        __uint128_t r = (__uint128_t)*a * *b;
+        *a = (uint64_t)r;
+        *b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t
+wymix(uint64_t a, uint64_t b)
+{
+        wymum(&a, &b);
+        return a ^ b;
+}
+
+static inline uint64_t
+read64(const uint8_t *p)
+{
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+}
+
+static inline uint64_t
+read32(const uint8_t *p)
+{
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+}
+
+/*
+ * wyhash (final version 4, public domain) of `len` bytes. Unlike dbj2 and
+ * java_hash it does not stop at a NUL, and it reads 8 bytes at a time.
+ * Keys of 48 bytes or more go through three independent multiply chains
+ * per 48 byte block, which the CPU overlaps.
+ */
+static inline hash_t
+hash_bytes(const void *key, size_t len)
+{
+        static const uint64_t secret[4] = {
+                0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+        };
+        const uint8_t *p = (const uint8_t *)key;
+        uint64_t seed = wymix(secret[0], secret[1]);
+        uint64_t a, b;
+
+        if (len <= 16) {
+                if (len >= 4) {
+                        a = (read32(p) << 32) | read32(p + ((len >> 3) << 2));
+                        b = (read32(p + len - 4) << 32)
+                            | read32(p + len - 4 - ((len >> 3) << 2));
+                } else if (len > 0) {
+                        a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8)
+                            | p[len - 1];
+                        b = 0;
+                } else {
+                        a = b = 0;
+                }
+        } else {
+                size_t i = len;
+                if (i >= 48) {
+                        uint64_t see1 = seed, see2 = seed;
+                        do {
+                                seed = wymix(read64(p) ^ secret[1],
+                                             read64(p + 8) ^ seed);
+                                see1 = wymix(read64(p + 16) ^ secret[2],
+                                             read64(p + 24) ^ see1);
+                                see2 = wymix(read64(p + 32) ^ secret[3],
+                                             read64(p + 40) ^ see2);
+                                p += 48;
+                                i -= 48;
+                        } while (i >= 48);
+                        seed ^= see1 ^ see2;
+                }
+                while (i > 16) {
+                        seed = wymix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+                        i -= 16;
+                        p += 16;
+                }
+                a = read64(p + i - 16);
+                b = read64(p + i - 8);
+        }
+
+        a ^= secret[1];
+        b ^= seed;
+        wymum(&a, &b);
+        hash_t x = wymix(a ^ secret[0] ^ len, b ^ secret[1]);
+        return (x == (hash_t)-1) ? (hash_t)-2 : x;
 }
 
 
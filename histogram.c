@@ -0,0 +1,46 @@
+//
+// A log-bucketed latency histogram for per-operation benchmarks
+//
+
+#include "histogram.h"
+
+#include <string.h>
+
+void
+histogram_reset (histogram *h)
+{
+  memset (h, 0, sizeof (histogram));
+}
+
+/* the largest value that falls into bucket `b` */
+static uint64_t
+histogram_bucket_top (unsigned b)
+{
+  if (b < 2 * HISTOGRAM_SUB_COUNT)
+    return b;
+  unsigned shift = b / HISTOGRAM_SUB_COUNT - 1;
+  uint64_t mantissa = b % HISTOGRAM_SUB_COUNT + HISTOGRAM_SUB_COUNT;
+  return (mantissa << shift) + ((uint64_t)1 << shift) - 1;
+}
+
+uint64_t
+histogram_percentile (const histogram *h, double p)
+{
+  if (h->hg_total == 0)
+    return 0;
+  uint64_t rank = (uint64_t)(p * (double)h->hg_total);
+  if (rank >= h->hg_total)
+    rank = h->hg_total - 1;
+
+  uint64_t seen = 0;
+  for (unsigned b = 0; b < HISTOGRAM_BUCKETS; b++)
+    {
+      seen += h->hg_counts[b];
+      if (seen > rank)
+        {
+          uint64_t top = histogram_bucket_top (b);
+          return top < h->hg_max ? top : h->hg_max;
+        }
+    }
+  return h->hg_max;
+}
@@ -0,0 +1,62 @@
+//
+// A log-bucketed latency histogram for per-operation benchmarks
+//
+
+#ifndef HASHTABLE_HISTOGRAM_H
+#define HASHTABLE_HISTOGRAM_H
+
+#include <stdint.h>
+
+/* Each power of two is split into 2^HISTOGRAM_SUB_BITS buckets, so a
+   recorded value is known to within 1 / 2^HISTOGRAM_SUB_BITS (about 3%) */
+#define HISTOGRAM_SUB_BITS (5)
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+/**
+ * @brief An HDR-style histogram of 64 bit values (e.g. nanoseconds)
+ *
+ * Values below HISTOGRAM_SUB_COUNT get a bucket each. Above that, every
+ * [2^e, 2^(e+1)) range is cut into HISTOGRAM_SUB_COUNT equal buckets, so
+ * the relative precision is the same at 20ns as at 20ms, and recording is
+ * a couple of shifts and an increment.
+ *
+ */
+typedef struct histogram
+{
+        uint64_t        hg_counts[HISTOGRAM_BUCKETS];
+        uint64_t        hg_total;       // number of recorded values
+        uint64_t        hg_max;         // exact largest recorded value
+} histogram;
+
+/* the bucket of `v` */
+static inline unsigned
+histogram_bucket (uint64_t v)
+{
+  if (v < HISTOGRAM_SUB_COUNT)
+    return (unsigned)v;
+  unsigned shift = 63 - __builtin_clzll (v) - HISTOGRAM_SUB_BITS;
+  return shift * HISTOGRAM_SUB_COUNT + (unsigned)(v >> shift);
+}
+
+static inline void
+histogram_record (histogram *h, uint64_t v)
+{
+  h->hg_counts[histogram_bucket (v)]++;
+  h->hg_total++;
+  if (v > h->hg_max)
+    h->hg_max = v;
+}
+
+void histogram_reset(histogram *h);
+
+/**
+ * @brief The value below or at which a fraction `p` of the recorded values
+ * lie, rounded up to the top of its bucket
+ *
+ * @param p in [0, 1]; 0.999 for the 99.9th percentile
+ * @return uint64_t 0 for an empty histogram
+ */
+uint64_t histogram_percentile(const histogram *h, double p);
+
+#endif //HASHTABLE_HISTOGRAM_H
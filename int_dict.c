@@ -0,0 +1,75 @@
+//
+// A dict keyed by 64 bit integers
+//
+
+#include "int_dict.h"
+
+#include "hashes.h"
+
+/* the generated index takes the first slot from the low bits of the hash,
+   and those of a Fibonacci hash are its weakest */
+static inline hash_t
+int_hash (ikey_t key)
+{
+  hash_t h = hash_int64 (key);
+  return (h >> 32) | (h << 32);
+}
+
+static inline int
+int_eq (ikey_t a, ikey_t b)
+{
+  return a == b;
+}
+
+DICT_DEFINE (int_table, ikey_t, dval_t, int_hash, int_eq)
+
+int_dict *
+int_dict_new (size_t nentries)
+{
+  return int_table_new (nentries);
+}
+
+int
+int_dict_free (int_dict *id)
+{
+  return int_table_free (id);
+}
+
+int
+int_dict_insert (int_dict *id, ikey_t key, dval_t value)
+{
+  if (!value)
+    return INVALID_INPUT;
+  return int_table_insert (id, key, value);
+}
+
+dval_t
+int_dict_getvalue (int_dict *id, ikey_t key)
+{
+  dval_t *value = int_table_get (id, key);
+  return value ? *value : NULL;
+}
+
+int
+int_dict_contains (int_dict *id, ikey_t key)
+{
+  return int_table_contains (id, key);
+}
+
+int
+int_dict_delitem (int_dict *id, ikey_t key)
+{
+  return int_table_delitem (id, key);
+}
+
+ssize_t
+int_dict_size (int_dict *id)
+{
+  return int_table_size (id);
+}
+
+int
+int_dict_clear (int_dict *id)
+{
+  return int_table_clear (id);
+}
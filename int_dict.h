@@ -0,0 +1,62 @@
+//
+// A dict keyed by 64 bit integers
+//
+
+#ifndef HASHTABLE_INT_DICT_H
+#define HASHTABLE_INT_DICT_H
+
+#include "dict_generic.h"
+
+/* The key type of an int_dict */
+typedef int64_t ikey_t;
+
+/* The table behind int_dict, generated by DICT_DEFINE in int_dict.c */
+DICT_DECLARE (int_table, ikey_t, dval_t)
+
+/**
+ * @brief A dictionary keyed by int64_t
+ *
+ * A DICT_DEFINE table: entries in insertion order, plus a compact
+ * int8/16/32/64 index of entry positions probed along the perturb
+ * sequence, with a resize dropping the deleted entries. Keys are hashed
+ * with hash_int64 (Fibonacci hashing) rotated by 32 bits, so that the well
+ * mixed high half of the product picks the first slot. They are compared
+ * as integers, so every int64_t is a distinct key (unlike a double, which
+ * is exact only up to 2^53).
+ *
+ */
+typedef int_table int_dict;
+
+/**
+ * @brief create an int_dict that holds `nentries` keys without resizing
+ *
+ * @return int_dict*, or NULL if out of memory
+ */
+int_dict *int_dict_new(size_t nentries);
+
+int int_dict_free(int_dict *id);
+
+/**
+ * @brief insert `key` or overwrite its value
+ *
+ * @return int OK, OK_REPLACED, or INVALID_INPUT / INTERNAL_ERROR
+ */
+int int_dict_insert(int_dict *id, ikey_t key, dval_t value);
+
+/* the value of `key`, or NULL if it is absent */
+dval_t int_dict_getvalue(int_dict *id, ikey_t key);
+
+int int_dict_contains(int_dict *id, ikey_t key);
+
+/**
+ * @brief remove `key`
+ *
+ * @return int (0) if it was removed, (-1) if it was absent
+ */
+int int_dict_delitem(int_dict *id, ikey_t key);
+
+ssize_t int_dict_size(int_dict *id);
+
+int int_dict_clear(int_dict *id);
+
+#endif //HASHTABLE_INT_DICT_H
@@ -1,12 +1,22 @@
 #include "dict.h"
+#include "dict_generic.h"
+#include "hashes.h"
+#include "histogram.h"
+#include "int_dict.h"
+#include "perf_counters.h"
+#include "sharded_dict.h"
+#include "str_dict.h"
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 
 /*
- * instructions change from NONE {NULL, EMPTY}
- * change repr_key, repr_val
- * change dval_t, dkey_t
- * change val_eq & key_eq
+ * dict is fixed to dkey_t keys and dval_t values; for other types
+ * instantiate a dict with DICT_DEFINE from dict_generic.h
  */
 
 #define _diffsec(start, end) (end.tv_sec - start.tv_sec)
@@ -26,19 +36,84 @@ void test_dict_insert (ssize_t maxlen);
 
 void test_dict_initialized (ssize_t maxlen);
 
+void bench_lookup_batch (void);
+
+void bench_hash_kinds (ssize_t n);
+
+void bench_op_latency (ssize_t n);
+
+void bench_sharded_scaling (ssize_t nkeys, ssize_t ops_per_thread);
+
+void bench_churn (ssize_t n, int rounds);
+
+void bench_int_keys (ssize_t n);
+
+void bench_generic_dict (ssize_t n);
+
+void bench_string_keys (ssize_t n);
+
+void bench_value_reads (ssize_t n);
+
+void bench_value_ownership (ssize_t n);
+
+void bench_allocations (ssize_t n);
+
+void bench_hugepages (ssize_t n);
+
+void bench_upsert (ssize_t n);
+
+void bench_fingerprints (int log2_slots);
+
+void bench_index_widths (ssize_t nops);
+
+void bench_compaction (ssize_t n);
+
+void bench_load_factors (ssize_t n);
+
+/*
+ * `hashtable latency` only runs the per-operation latency benchmark, and
+ * `hashtable hugepages` the huge page one at 10M and 100M keys, which
+ * takes about 6 GiB
+ */
 int
-main (void)
+main (int argc, char **argv)
 {
+  if (argc > 1 && strcmp (argv[1], "latency") == 0)
+    {
+      bench_op_latency (4000000);
+      return EXIT_SUCCESS;
+    }
+  if (argc > 1 && strcmp (argv[1], "hugepages") == 0)
+    {
+      bench_hugepages (10000000);
+      bench_hugepages (100000000);
+      return EXIT_SUCCESS;
+    }
   test_dict_insert (4000000);
+  bench_lookup_batch ();
+  bench_hash_kinds (1000000);
+  bench_op_latency (4000000);
+  bench_sharded_scaling (1000000, 1000000);
+  bench_churn (1000000, 4);
+  bench_int_keys (4000000);
+  bench_generic_dict (4000000);
+  bench_string_keys (1000000);
+  bench_value_reads (4000000);
+  bench_value_ownership (4000000);
+  bench_allocations (4000000);
+  bench_hugepages (10000000);
+  bench_upsert (4000000);
+  bench_fingerprints (22);
+  bench_index_widths (4000000);
+  bench_compaction (4000000);
+  bench_load_factors (1000000);
   return EXIT_SUCCESS;
 }
 
-struct timeval tv;
+/* draws from random (), so runs seeded through srandom are reproducible */
 static char *
 randstring (uint max_length)
 {
-  gettimeofday (&tv, NULL);
-  srandom (tv.tv_usec);
   uint rand_length = 1 + ((unsigned long)random () % max_length);
   char *string = SAFEMALLOC (sizeof (*string) * (rand_length + 1));
 
@@ -75,6 +150,7 @@ test_dict_insert (ssize_t maxlen)
   dval_t *values = SAFEMALLOC (sizeof (*values) * maxlen);
   dkey_t *keys = SAFEMALLOC (sizeof (*keys) * maxlen);
 
+  srandom (42);
   for (ssize_t i = 0; i < maxlen; i++)
     {
       keys[i] = randfrom (0, RAND_MAX);
@@ -97,20 +173,22 @@ test_dict_insert (ssize_t maxlen)
           fprintf (stderr, "%d\n", n_owrites);
           goto Fail;
         }
+    }
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  assert (n_owrites + mp->dt_active_entries_count == maxlen);
+
+  for (ssize_t i = 0; i < maxlen; i++)
+    {
       if (!dict_contains (mp, keys[i]))
         {
           fprintf (stderr, "Failure\n");
           goto Fail;
         }
     }
-  assert (n_owrites + mp->dt_active_entries_count == maxlen);
-
-  clock_gettime (CLOCK_MONOTONIC, &end);
 
   printf ("Number of overwrites: %d\n", n_owrites);
   double time = diffmilli (start, end);
-  printf ("time taken for %zd `insert`s and `dict_contains`: %.5f ms\n",
-          maxlen, time);
+  printf ("time taken for %zd `insert`s: %.5f ms\n", maxlen, time);
 
   free (keys);
   dict_printinfo (mp);
@@ -169,3 +247,1071 @@ Fail:
   free (keys);
   free_strings (values, maxlen);
 }
+
+/* compare per-key dict_getvalue against dict_lookup_batch */
+void
+bench_lookup_batch (void)
+{
+  static char value[] = "value";
+  printf ("%10s %16s %16s\n", "size", "per-key Mops/s", "batch Mops/s");
+  for (ssize_t n = 1 << 12; n <= 1 << 22; n <<= 2)
+    {
+      dkey_t *keys = SAFEMALLOC (sizeof (*keys) * n);
+      dval_t *values = SAFEMALLOC (sizeof (*values) * n);
+      dict *mp = dict_new_empty ();
+
+      srandom (42);
+      for (ssize_t i = 0; i < n; i++)
+        {
+          keys[i] = randfrom (0, RAND_MAX);
+          dict_insert (mp, keys[i], value);
+        }
+      /* query in a different order than insertion */
+      for (ssize_t i = n - 1; i > 0; i--)
+        {
+          ssize_t j = random () % (i + 1);
+          dkey_t t = keys[i];
+          keys[i] = keys[j];
+          keys[j] = t;
+        }
+
+      struct timespec start, end;
+      ssize_t found = 0;
+      clock_gettime (CLOCK_MONOTONIC, &start);
+      for (ssize_t i = 0; i < n; i++)
+        found += dict_getvalue (mp, keys[i]) != NULL;
+      clock_gettime (CLOCK_MONOTONIC, &end);
+      double single = n / diffmicro (start, end);
+
+      clock_gettime (CLOCK_MONOTONIC, &start);
+      found -= dict_lookup_batch (mp, keys, n, values);
+      clock_gettime (CLOCK_MONOTONIC, &end);
+      double batched = n / diffmicro (start, end);
+
+      assert (found == 0);
+      printf ("%10zd %16.2f %16.2f\n", n, single, batched);
+
+      dict_free (mp);
+      free (values);
+      free (keys);
+    }
+}
+
+/* hash cost and mean probe length of each hash_kind_t on a few key sets */
+void
+bench_hash_kinds (ssize_t n)
+{
+  static char value[] = "value";
+  static const char *set_names[] = { "uniform", "integral", "clustered" };
+  static const char *hash_names[] = { "hash_double", "hash_double_fast" };
+  dkey_t *keys = SAFEMALLOC (sizeof (*keys) * n);
+
+  printf ("%10s %18s %10s %14s\n", "keys", "hash", "ns/key", "mean probes");
+  for (int set = 0; set < 3; set++)
+    {
+      srandom (42);
+      for (ssize_t i = 0; i < n; i++)
+        {
+          if (set == 0)
+            keys[i] = randfrom (0, RAND_MAX);
+          else if (set == 1)
+            keys[i] = (dkey_t)i;
+          else /* runs of 1024 closely spaced keys */
+            keys[i] = (double)(i >> 10) * 1e6 + (double)(i & 1023) * 0.25;
+        }
+      for (int kind = HASH_DOUBLE; kind <= HASH_FAST; kind++)
+        {
+          dict_config config
+              = { .index_kind = INDEX_COMPACT, .hash_kind = kind };
+          dict *mp = dict_new_configured (0, &config);
+
+          struct timespec start, end;
+          volatile hash_t sink = 0;
+          clock_gettime (CLOCK_MONOTONIC, &start);
+          for (ssize_t i = 0; i < n; i++)
+            sink += dict_hash (mp, keys[i]);
+          clock_gettime (CLOCK_MONOTONIC, &end);
+
+          for (ssize_t i = 0; i < n; i++)
+            dict_insert (mp, keys[i], value);
+          printf ("%10s %18s %10.2f %14.3f\n", set_names[set],
+                  hash_names[kind], diffnano (start, end) / n,
+                  dict_mean_probe_length (mp));
+          dict_free (mp);
+        }
+    }
+  free (keys);
+}
+
+/*
+ * What an operation on a dict leaves behind when it rebuilt the index:
+ * only a rebuild raises dt_free_count, while every insert appends one entry
+ * and takes one free slot. An incremental resize counts for as long as it
+ * is migrating entries.
+ */
+typedef struct index_state
+{
+  ssize_t free;
+  ssize_t used;
+  bool rehashing;
+} index_state;
+
+static inline index_state
+index_state_of (const dict *mp)
+{
+  return (index_state){ mp->dt_free_count, mp->dt_entries.ar_used_count,
+                        mp->dt_old_indices != NULL };
+}
+
+static inline bool
+index_was_rebuilt (const dict *mp, index_state before)
+{
+  index_state after = index_state_of (mp);
+  return before.rehashing || after.rehashing
+         || after.free > before.free - (after.used - before.used);
+}
+
+enum
+{
+  OP_INSERT,
+  OP_LOOKUP_HIT,
+  OP_LOOKUP_MISS,
+  OP_OVERWRITE,
+  OP_DELETE,
+  OP_COUNT
+};
+
+/* latencies of one operation type, split by whether the index was rebuilt */
+typedef struct op_latency
+{
+  histogram all;
+  histogram rebuild;
+} op_latency;
+
+static void
+print_op_latency (const char *resize, const char *op, const op_latency *l)
+{
+  printf ("%12s %10s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12" PRIu64
+          " %10" PRIu64 " %12" PRIu64 "\n",
+          resize, op, histogram_percentile (&l->all, 0.5),
+          histogram_percentile (&l->all, 0.99),
+          histogram_percentile (&l->all, 0.999), l->all.hg_max,
+          l->rebuild.hg_total, l->rebuild.hg_max);
+}
+
+/*
+ * Time every single operation on a dict of `n` keys, with and without
+ * incremental resizing, and report its latency percentiles. Samples during
+ * which the index was rebuilt are also counted separately.
+ */
+void
+bench_op_latency (ssize_t n)
+{
+  static char value[] = "value", other[] = "other";
+  static const char *op_names[]
+      = { "insert", "hit", "miss", "overwrite", "delete" };
+  static op_latency latency[OP_COUNT];
+  dkey_t *keys = SAFEMALLOC (sizeof (*keys) * n);
+
+  srandom (42);
+  for (ssize_t i = 0; i < n; i++)
+    keys[i] = randfrom (0, RAND_MAX);
+
+  printf ("%12s %10s %10s %10s %10s %12s %10s %12s\n", "resize", "op",
+          "p50 ns", "p99 ns", "p99.9 ns", "max ns", "rebuilds",
+          "rebuild max");
+  for (int incremental = 0; incremental <= 1; incremental++)
+    {
+      dict_config config = { .index_kind = INDEX_COMPACT,
+                             .hash_kind = DICT_DEFAULT_HASH,
+                             .incremental_resize = incremental };
+      dict *mp = dict_new_configured (0, &config);
+      for (int op = 0; op < OP_COUNT; op++)
+        {
+          histogram_reset (&latency[op].all);
+          histogram_reset (&latency[op].rebuild);
+        }
+
+      struct timespec start, end;
+      for (int op = 0; op < OP_COUNT; op++)
+        for (ssize_t i = 0; i < n; i++)
+          {
+            index_state before = index_state_of (mp);
+            clock_gettime (CLOCK_MONOTONIC, &start);
+            switch (op)
+              {
+              case OP_INSERT:
+                dict_insert (mp, keys[i], value);
+                break;
+              case OP_LOOKUP_HIT:
+                dict_contains (mp, keys[i]);
+                break;
+              case OP_LOOKUP_MISS:
+                dict_contains (mp, -keys[i] - 1);
+                break;
+              case OP_OVERWRITE:
+                dict_insert (mp, keys[i], other);
+                break;
+              default:
+                dict_delitem (mp, keys[i]);
+              }
+            clock_gettime (CLOCK_MONOTONIC, &end);
+            uint64_t ns = (uint64_t)diffnano (start, end);
+            histogram_record (&latency[op].all, ns);
+            if (index_was_rebuilt (mp, before))
+              histogram_record (&latency[op].rebuild, ns);
+          }
+
+      for (int op = 0; op < OP_COUNT; op++)
+        print_op_latency (incremental ? "incremental" : "full", op_names[op],
+                          &latency[op]);
+      dict_free (mp);
+    }
+  free (keys);
+}
+
+typedef struct scaling_task
+{
+  sharded_dict *sd;
+  ssize_t nkeys;
+  ssize_t nops;
+  int write_percent;
+  uint64_t seed;
+} scaling_task;
+
+static void *
+scaling_worker (void *arg)
+{
+  static char value[] = "value";
+  scaling_task *t = arg;
+  uint64_t x = t->seed;
+  for (ssize_t i = 0; i < t->nops; i++)
+    {
+      /* xorshift64, so workers do not share random()'s state */
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      dkey_t key = (dkey_t)((x >> 8) % (uint64_t)t->nkeys);
+      int op = (int)(x % 100);
+      if (op >= t->write_percent)
+        sharded_dict_getvalue (t->sd, key);
+      else if (op & 1)
+        sharded_dict_delitem (t->sd, key);
+      else
+        sharded_dict_insert (t->sd, key, value);
+    }
+  return NULL;
+}
+
+/* throughput of a single-lock dict and a 64-shard dict from 1 to N threads */
+void
+bench_sharded_scaling (ssize_t nkeys, ssize_t ops_per_thread)
+{
+  static char value[] = "value";
+  static const int write_percents[] = { 5, 50 };
+  long ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (ncpus < 1)
+    ncpus = 1;
+
+  printf ("%8s %8s %8s %12s\n", "writes", "shards", "threads", "Mops/s");
+  for (int w = 0; w < 2; w++)
+    for (unsigned log2_shards = 0; log2_shards <= 6; log2_shards += 6)
+      for (long nthreads = 1; nthreads <= ncpus;
+           nthreads = (nthreads == ncpus || 2 * nthreads < ncpus)
+                          ? 2 * nthreads
+                          : ncpus)
+        {
+          sharded_dict *sd = sharded_dict_new (log2_shards, NULL);
+          for (ssize_t i = 0; i < nkeys; i += 2)
+            sharded_dict_insert (sd, (dkey_t)i, value);
+
+          pthread_t threads[nthreads];
+          scaling_task tasks[nthreads];
+          struct timespec start, end;
+          clock_gettime (CLOCK_MONOTONIC, &start);
+          for (long t = 0; t < nthreads; t++)
+            {
+              tasks[t] = (scaling_task){ sd, nkeys, ops_per_thread,
+                                         write_percents[w], 0x9E3779B9 + t };
+              pthread_create (&threads[t], NULL, scaling_worker, &tasks[t]);
+            }
+          for (long t = 0; t < nthreads; t++)
+            pthread_join (threads[t], NULL);
+          clock_gettime (CLOCK_MONOTONIC, &end);
+
+          printf ("%7d%% %8u %8ld %12.2f\n", write_percents[w],
+                  1u << log2_shards, nthreads,
+                  nthreads * ops_per_thread / diffmicro (start, end));
+          sharded_dict_free (sd);
+        }
+}
+
+/*
+ * Delete-and-reinsert churn: every round replaces each of the `n` keys of
+ * the dict by a fresh one, then times lookups of absent keys, which walk
+ * the longest probes.
+ */
+void
+bench_churn (ssize_t n, int rounds)
+{
+  static char value[] = "value";
+  static const char *index_names[] = { "compact", "swiss", "robin hood" };
+  dkey_t *live = SAFEMALLOC (sizeof (*live) * n);
+  dkey_t *fresh = SAFEMALLOC (sizeof (*fresh) * n * rounds);
+  dkey_t *absent = SAFEMALLOC (sizeof (*absent) * n);
+
+  srandom (42);
+  for (ssize_t i = 0; i < n; i++)
+    absent[i] = -randfrom (1, RAND_MAX);
+  for (ssize_t i = 0; i < n * rounds; i++)
+    fresh[i] = randfrom (0, RAND_MAX);
+
+  printf ("%12s %6s %14s %14s %14s\n", "index", "round", "churn ns/op",
+          "miss ns/op", "mean probes");
+  for (int kind = INDEX_COMPACT; kind <= INDEX_ROBIN_HOOD; kind++)
+    {
+      dict *mp = dict_new_with_index (0, kind);
+      srandom (7);
+      for (ssize_t i = 0; i < n; i++)
+        {
+          live[i] = randfrom (0, RAND_MAX);
+          dict_insert (mp, live[i], value);
+        }
+      for (int r = 0; r <= rounds; r++)
+        {
+          struct timespec start, end;
+          double churn = 0;
+          if (r > 0)
+            {
+              const dkey_t *batch = fresh + (r - 1) * n;
+              clock_gettime (CLOCK_MONOTONIC, &start);
+              for (ssize_t i = 0; i < n; i++)
+                {
+                  dict_delitem (mp, live[i]);
+                  dict_insert (mp, batch[i], value);
+                  live[i] = batch[i];
+                }
+              clock_gettime (CLOCK_MONOTONIC, &end);
+              churn = diffnano (start, end) / n;
+            }
+
+          ssize_t found = 0;
+          clock_gettime (CLOCK_MONOTONIC, &start);
+          for (ssize_t i = 0; i < n; i++)
+            found += dict_contains (mp, absent[i]);
+          clock_gettime (CLOCK_MONOTONIC, &end);
+          assert (found == 0);
+
+          printf ("%12s %6d %14.1f %14.1f %14.3f\n", index_names[kind], r,
+                  churn, diffnano (start, end) / n,
+                  dict_mean_probe_length (mp));
+        }
+      dict_free (mp);
+    }
+  free (absent);
+  free (fresh);
+  free (live);
+}
+
+/*
+ * 64 bit integer IDs in an int_dict against the same IDs cast to double in
+ * a dict. IDs beyond 2^53 that differ only in their low bits collide once
+ * cast, in which case the dict keeps fewer keys.
+ */
+void
+bench_int_keys (ssize_t n)
+{
+  static char value[] = "value";
+  static const char *set_names[] = { "sequential", "random 64 bit" };
+  int64_t *ids = SAFEMALLOC (sizeof (*ids) * n);
+
+  printf ("%14s %18s %12s %12s %12s\n", "ids", "table", "insert ns",
+          "lookup ns", "keys kept");
+  for (int set = 0; set < 2; set++)
+    {
+      srandom (42);
+      for (ssize_t i = 0; i < n; i++)
+        ids[i] = set == 0 ? (int64_t)i
+                          : (int64_t)(((uint64_t)random () << 33)
+                                      ^ ((uint64_t)random () << 11)
+                                      ^ (uint64_t)random ());
+
+      struct timespec start, mid, end;
+      int_dict *id = int_dict_new (0);
+      clock_gettime (CLOCK_MONOTONIC, &start);
+      for (ssize_t i = 0; i < n; i++)
+        int_dict_insert (id, ids[i], value);
+      clock_gettime (CLOCK_MONOTONIC, &mid);
+      ssize_t found = 0;
+      for (ssize_t i = 0; i < n; i++)
+        found += int_dict_contains (id, ids[i]);
+      clock_gettime (CLOCK_MONOTONIC, &end);
+      assert (found == n);
+      printf ("%14s %18s %12.1f %12.1f %12zd\n", set_names[set], "int_dict",
+              diffnano (start, mid) / n, diffnano (mid, end) / n,
+              int_dict_size (id));
+      int_dict_free (id);
+
+      for (int kind = HASH_DOUBLE; kind <= HASH_FAST; kind++)
+        {
+          dict_config config
+              = { .index_kind = INDEX_COMPACT, .hash_kind = kind };
+          dict *mp = dict_new_configured (0, &config);
+          clock_gettime (CLOCK_MONOTONIC, &start);
+          for (ssize_t i = 0; i < n; i++)
+            dict_insert (mp, (dkey_t)ids[i], value);
+          clock_gettime (CLOCK_MONOTONIC, &mid);
+          for (ssize_t i = 0; i < n; i++)
+            dict_contains (mp, (dkey_t)ids[i]);
+          clock_gettime (CLOCK_MONOTONIC, &end);
+          printf ("%14s %18s %12.1f %12.1f %12zd\n", set_names[set],
+                  kind == HASH_FAST ? "dict, fast hash" : "dict",
+                  diffnano (start, mid) / n, diffnano (mid, end) / n,
+                  dict_size (mp));
+          dict_free (mp);
+        }
+    }
+  free (ids);
+}
+
+static int
+dkey_eq (dkey_t a, dkey_t b)
+{
+  return a == b;
+}
+
+/* dict's key and value types, with the hash and equality inlined */
+DICT_DECLARE (gdict, dkey_t, dval_t)
+DICT_DEFINE (gdict, dkey_t, dval_t, hash_double_fast, dkey_eq)
+
+/*
+ * A DICT_DEFINE instantiation against dict configured with the same hash,
+ * which dispatches on its hash, index kind and resize policy at run time.
+ */
+void
+bench_generic_dict (ssize_t n)
+{
+  static char value[] = "value";
+  dkey_t *keys = SAFEMALLOC (sizeof (*keys) * n);
+  srandom (42);
+  for (ssize_t i = 0; i < n; i++)
+    keys[i] = randfrom (0, RAND_MAX);
+
+  struct timespec start, mid, end;
+  ssize_t found = 0;
+  dict_config config = { .index_kind = INDEX_COMPACT, .hash_kind = HASH_FAST };
+  dict *mp = dict_new_configured (0, &config);
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (ssize_t i = 0; i < n; i++)
+    dict_insert (mp, keys[i], value);
+  clock_gettime (CLOCK_MONOTONIC, &mid);
+  for (ssize_t i = 0; i < n; i++)
+    found += dict_contains (mp, keys[i]);
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  printf ("%18s %12s %12s\n", "table", "insert ns", "lookup ns");
+  printf ("%18s %12.1f %12.1f\n", "dict", diffnano (start, mid) / n,
+          diffnano (mid, end) / n);
+  dict_free (mp);
+
+  gdict *gd = gdict_new (0);
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (ssize_t i = 0; i < n; i++)
+    gdict_insert (gd, keys[i], value);
+  clock_gettime (CLOCK_MONOTONIC, &mid);
+  for (ssize_t i = 0; i < n; i++)
+    found -= gdict_contains (gd, keys[i]);
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  assert (found == 0);
+  printf ("%18s %12.1f %12.1f\n", "DICT_DEFINE", diffnano (start, mid) / n,
+          diffnano (mid, end) / n);
+  gdict_free (gd);
+  free (keys);
+}
+
+static hash_t
+cstring_hash (const char *s)
+{
+  return dbj2 ((unsigned char *)s);
+}
+
+static int
+cstring_eq (const char *a, const char *b)
+{
+  return strcmp (a, b) == 0;
+}
+
+/* one heap pointer per key, hashed a byte at a time */
+DICT_DECLARE (cstring_dict, const char *, dval_t)
+DICT_DEFINE (cstring_dict, const char *, dval_t, cstring_hash, cstring_eq)
+
+/*
+ * str_dict, with hash_bytes and its keys in an arena, against NUL
+ * terminated keys hashed with dbj2 and held by pointer, on random strings
+ * of 1 to `max_length` characters.
+ */
+void
+bench_string_keys (ssize_t n)
+{
+  static char value[] = "value";
+  static const size_t lengths[] = { 20, 200 };
+  char **keys = SAFEMALLOC (sizeof (*keys) * n);
+  size_t *lens = SAFEMALLOC (sizeof (*lens) * n);
+
+  printf ("%10s %18s %12s %12s\n", "max length", "table", "insert ns",
+          "lookup ns");
+  for (int l = 0; l < 2; l++)
+    {
+      srandom (42);
+      for (ssize_t i = 0; i < n; i++)
+        {
+          keys[i] = randstring (lengths[l]);
+          lens[i] = strlen (keys[i]);
+        }
+
+      struct timespec start, mid, end;
+      ssize_t found = 0;
+      str_dict *sd = str_dict_new (0);
+      clock_gettime (CLOCK_MONOTONIC, &start);
+      for (ssize_t i = 0; i < n; i++)
+        str_dict_insert (sd, keys[i], lens[i], value);
+      clock_gettime (CLOCK_MONOTONIC, &mid);
+      for (ssize_t i = 0; i < n; i++)
+        found += str_dict_contains (sd, keys[i], lens[i]);
+      clock_gettime (CLOCK_MONOTONIC, &end);
+      printf ("%10zu %18s %12.1f %12.1f\n", lengths[l], "str_dict",
+              diffnano (start, mid) / n, diffnano (mid, end) / n);
+      str_dict_free (sd);
+
+      cstring_dict *cd = cstring_dict_new (0);
+      clock_gettime (CLOCK_MONOTONIC, &start);
+      for (ssize_t i = 0; i < n; i++)
+        cstring_dict_insert (cd, keys[i], value);
+      clock_gettime (CLOCK_MONOTONIC, &mid);
+      for (ssize_t i = 0; i < n; i++)
+        found -= cstring_dict_contains (cd, keys[i]);
+      clock_gettime (CLOCK_MONOTONIC, &end);
+      assert (found == 0);
+      printf ("%10zu %18s %12.1f %12.1f\n", lengths[l], "dbj2, by pointer",
+              diffnano (start, mid) / n, diffnano (mid, end) / n);
+      cstring_dict_free (cd);
+
+      for (ssize_t i = 0; i < n; i++)
+        free (keys[i]);
+    }
+  free (lens);
+  free (keys);
+}
+
+/*
+ * Insert `n` values of randstring (20), then look up random keys and read
+ * their values. Built with DICT_INLINE_VALUES, the dict copies the strings
+ * into its entries, so reading one is no extra cache miss.
+ */
+void
+bench_value_reads (ssize_t n)
+{
+  dkey_t *keys = SAFEMALLOC (sizeof (*keys) * n);
+  dval_t *values = SAFEMALLOC (sizeof (*values) * n);
+  ssize_t *order = SAFEMALLOC (sizeof (*order) * n);
+  srandom (42);
+  for (ssize_t i = 0; i < n; i++)
+    {
+      keys[i] = randfrom (0, RAND_MAX);
+      values[i] = randstring (20);
+      order[i] = (ssize_t)((unsigned long)random () % n);
+    }
+
+  struct timespec start, mid, end;
+  size_t total = 0;
+  dict *dt = dict_new_empty ();
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (ssize_t i = 0; i < n; i++)
+    dict_insert (dt, keys[i], values[i]);
+  clock_gettime (CLOCK_MONOTONIC, &mid);
+  for (ssize_t i = 0; i < n; i++)
+    total += strlen (dict_getvalue (dt, keys[order[i]]));
+  clock_gettime (CLOCK_MONOTONIC, &end);
+
+#ifdef DICT_INLINE_VALUES
+  const char *layout = "inline";
+#else
+  const char *layout = "pointer";
+#endif
+  printf ("%10s %12s %16s %14s\n", "values", "insert ns", "read value ns",
+          "bytes read");
+  printf ("%10s %12.1f %16.1f %14zu\n", layout, diffnano (start, mid) / n,
+          diffnano (mid, end) / n, total);
+  dict_free (dt);
+  free_strings (values, n);
+  free (order);
+  free (keys);
+}
+
+/*
+ * Values one malloc each, freed one by one after the dict, against values
+ * the dict copies into its arena and frees a chunk at a time. There are
+ * only n / 16 distinct values, so interning stores each once.
+ */
+void
+bench_value_ownership (ssize_t n)
+{
+  static const char *names[] = { "borrowed", "owned", "interned" };
+  dkey_t *keys = SAFEMALLOC (sizeof (*keys) * n);
+  srandom (42);
+  for (ssize_t i = 0; i < n; i++)
+    keys[i] = randfrom (0, RAND_MAX);
+
+  printf ("%10s %12s %14s %14s\n", "values", "insert ns", "teardown ms",
+          "bytes");
+  for (value_kind_t kind = VALUES_BORROWED; kind <= VALUES_INTERNED; kind++)
+    {
+      dict_config config = { .index_kind = INDEX_COMPACT,
+                             .hash_kind = DICT_DEFAULT_HASH,
+                             .value_kind = kind };
+      dval_t *values = SAFEMALLOC (sizeof (*values) * n);
+      char value[32];
+      struct timespec start, mid, end;
+
+      dict *dt = dict_new_configured (0, &config);
+      clock_gettime (CLOCK_MONOTONIC, &start);
+      for (ssize_t i = 0; i < n; i++)
+        {
+          snprintf (value, sizeof (value), "value %zd", i / 16);
+          if (kind == VALUES_BORROWED)
+            {
+              values[i] = SAFEMALLOC (strlen (value) + 1);
+              strcpy (values[i], value);
+            }
+          dict_insert (dt, keys[i],
+                       kind == VALUES_BORROWED ? values[i] : value);
+        }
+      clock_gettime (CLOCK_MONOTONIC, &mid);
+      ssize_t bytes = dict_sizeof (dt);
+      if (kind == VALUES_BORROWED)
+        bytes += n * 32; /* the smallest glibc malloc chunk */
+      dict_free (dt);
+      if (kind == VALUES_BORROWED)
+        free_strings (values, n);
+      else
+        free (values);
+      clock_gettime (CLOCK_MONOTONIC, &end);
+      printf ("%10s %12.1f %14.2f %14zd\n", names[kind],
+              diffnano (start, mid) / n, diffmilli (mid, end), bytes);
+    }
+  free (keys);
+}
+
+/* allocator calls and peak heap of growing a dict one insert at a time */
+void
+bench_allocations (ssize_t n)
+{
+  static const char *names[] = { "compact", "swiss", "robin hood" };
+  char value[] = "value";
+  dkey_t *keys = SAFEMALLOC (sizeof (*keys) * n);
+  srandom (42);
+  for (ssize_t i = 0; i < n; i++)
+    keys[i] = randfrom (0, RAND_MAX);
+
+  printf ("%12s %8s %10s %12s %16s\n", "index", "allocs", "reallocs",
+          "peak MiB", "peak bytes/key");
+  for (index_kind_t kind = INDEX_COMPACT; kind <= INDEX_ROBIN_HOOD; kind++)
+    {
+      alloc_stats stats = { 0 };
+      dict_allocator counting = counting_allocator (&stats);
+      dict_config config = { .index_kind = kind,
+                             .hash_kind = DICT_DEFAULT_HASH,
+                             .allocator = &counting };
+      dict *dt = dict_new_configured (0, &config);
+      for (ssize_t i = 0; i < n; i++)
+        dict_insert (dt, keys[i], value);
+      printf ("%12s %8zu %10zu %12.1f %16.1f\n", names[kind], stats.as_allocs,
+              stats.as_reallocs, stats.as_peak_bytes / 1048576.0,
+              (double)stats.as_peak_bytes / n);
+      dict_free (dt);
+    }
+  free (keys);
+}
+
+/* KiB of the process backed by transparent huge pages, or -1 if unknown */
+static long
+anon_huge_kib (void)
+{
+  FILE *f = fopen ("/proc/self/smaps_rollup", "r");
+  if (!f)
+    return -1;
+  char line[256];
+  long kib = -1;
+  while (fgets (line, sizeof (line), f))
+    if (sscanf (line, "AnonHugePages: %ld kB", &kib) == 1)
+      break;
+  fclose (f);
+  return kib;
+}
+
+/*
+ * Random hit lookups into a dict of `n` keys, with the index and entries on
+ * 4 KiB pages and then on 2 MiB ones. At this size nearly every lookup
+ * touches two pages no dTLB entry covers; huge pages let the TLB reach 512
+ * times as far. dTLB misses are only reported where perf events are open.
+ */
+void
+bench_hugepages (ssize_t n)
+{
+  static const char *names[] = { "4K pages", "2M pages" };
+  const dict_allocator *allocators[]
+      = { &dict_malloc_allocator, &dict_hugepage_allocator };
+  char value[] = "value";
+  dkey_t *keys = SAFEMALLOC (sizeof (*keys) * n);
+  srandom (42);
+  for (ssize_t i = 0; i < n; i++)
+    keys[i] = randfrom (0, RAND_MAX);
+
+  perf_counters pc;
+  perf_counters_open (&pc);
+  printf ("%10s %12s %14s %16s %12s\n", "keys", "pages", "Mlookups/s",
+          "dTLB miss/op", "THP MiB");
+  for (int a = 0; a < 2; a++)
+    {
+      dict_config config = { .index_kind = INDEX_COMPACT,
+                             .hash_kind = DICT_DEFAULT_HASH,
+                             .allocator = allocators[a] };
+      dict *dt = dict_new_configured (n, &config);
+      for (ssize_t i = 0; i < n; i++)
+        dict_insert (dt, keys[i], value);
+
+      struct timespec start, end;
+      uint64_t x = 42;
+      size_t found = 0;
+      perf_counters_reset (&pc);
+      perf_counters_start (&pc);
+      clock_gettime (CLOCK_MONOTONIC, &start);
+      for (ssize_t i = 0; i < n; i++)
+        {
+          x = x * 6364136223846793005ull + 1442695040888963407ull;
+          found += dict_contains (dt, keys[(x >> 33) % (uint64_t)n]) == 1;
+        }
+      clock_gettime (CLOCK_MONOTONIC, &end);
+      perf_counters_stop (&pc);
+
+      char misses[32] = "n/a";
+      if (perf_counters_available (&pc, PERF_DTLB_MISSES))
+        snprintf (misses, sizeof (misses), "%.3f",
+                  (double)pc.pc_counts[PERF_DTLB_MISSES] / n);
+      long thp = anon_huge_kib ();
+      printf ("%10zd %12s %14.2f %16s %12.1f\n", n, names[a],
+              found / diffmicro (start, end), misses,
+              thp < 0 ? -1.0 : thp / 1024.0);
+      dict_free (dt);
+    }
+  perf_counters_close (&pc);
+  free (keys);
+}
+
+static char digits[10][2]
+    = { "0", "1", "2", "3", "4", "5", "6", "7", "8", "9" };
+
+/* the next digit after `old`, wrapping around */
+static dval_t
+next_digit (dkey_t key, dval_t old, void *ctx)
+{
+  (void)key;
+  (void)ctx;
+  return digits[old ? (old[0] - '0' + 1) % 10 : 1];
+}
+
+/*
+ * A counter workload: `n` increments of n / 8 distinct keys, as a lookup
+ * followed by an insert and as one dict_upsert, for each index kind.
+ */
+void
+bench_upsert (ssize_t n)
+{
+  static const char *names[] = { "compact", "swiss", "robin hood" };
+  dkey_t *keys = SAFEMALLOC (sizeof (*keys) * n);
+  srandom (42);
+  for (ssize_t i = 0; i < n; i++)
+    keys[i] = (dkey_t)((unsigned long)random () % (n / 8));
+
+  printf ("%12s %18s %14s\n", "index", "get + insert ns", "upsert ns");
+  for (index_kind_t kind = INDEX_COMPACT; kind <= INDEX_ROBIN_HOOD; kind++)
+    {
+      dict_config config = { .index_kind = kind,
+                             .hash_kind = DICT_DEFAULT_HASH };
+      struct timespec start, end, start2, end2;
+
+      dict *dt = dict_new_configured (0, &config);
+      clock_gettime (CLOCK_MONOTONIC, &start);
+      for (ssize_t i = 0; i < n; i++)
+        dict_insert (dt, keys[i],
+                     next_digit (keys[i], dict_getvalue (dt, keys[i]), NULL));
+      clock_gettime (CLOCK_MONOTONIC, &end);
+      dict_free (dt);
+
+      dt = dict_new_configured (0, &config);
+      clock_gettime (CLOCK_MONOTONIC, &start2);
+      for (ssize_t i = 0; i < n; i++)
+        dict_upsert (dt, keys[i], next_digit, NULL);
+      clock_gettime (CLOCK_MONOTONIC, &end2);
+      dict_free (dt);
+      printf ("%12s %18.1f %14.1f\n", names[kind],
+              diffnano (start, end) / n, diffnano (start2, end2) / n);
+    }
+  free (keys);
+}
+
+/*
+ * Lookups, nearly all misses, into an index of 2^log2_slots slots at rising
+ * load factors, up to the 2/3 at which it would be resized. Every full slot
+ * along a miss's probe is a collision: INDEX_COMPACT reads its entry,
+ * INDEX_TAGGED and INDEX_SWISS first compare a byte of the hash.
+ */
+void
+bench_fingerprints (int log2_slots)
+{
+  static const double loads[] = { 0.35, 0.5, 0.66 };
+  static const index_kind_t kinds[] = { INDEX_COMPACT, INDEX_TAGGED,
+                                        INDEX_SWISS };
+  static const char *names[] = { "compact", "tagged", "swiss" };
+  char value[] = "value";
+  ssize_t slots = (ssize_t)1 << log2_slots;
+  ssize_t nmax = slots * 2 / 3 - 1;
+  dkey_t *keys = SAFEMALLOC (sizeof (*keys) * nmax);
+  dkey_t *lookups = SAFEMALLOC (sizeof (*lookups) * nmax);
+  srandom (42);
+  for (ssize_t i = 0; i < nmax; i++)
+    keys[i] = randfrom (0, RAND_MAX);
+
+  printf ("%10s %6s %12s %12s %12s\n", "index", "load", "miss ns",
+          "90% miss ns", "bytes/slot");
+  for (size_t l = 0; l < sizeof (loads) / sizeof (loads[0]); l++)
+    for (size_t k = 0; k < sizeof (kinds) / sizeof (kinds[0]); k++)
+      {
+        ssize_t n = (ssize_t)(loads[l] * slots);
+        if (n > nmax)
+          n = nmax;
+        dict_config config = { .index_kind = kinds[k],
+                               .hash_kind = DICT_DEFAULT_HASH };
+        dict *dt = dict_new_configured (nmax, &config);
+        for (ssize_t i = 0; i < n; i++)
+          dict_insert (dt, keys[i], value);
+        /* one in ten lookups is a hit */
+        for (ssize_t i = 0; i < nmax; i++)
+          lookups[i] = (i % 10) ? -keys[i] - 1 : keys[i % n];
+
+        struct timespec start, mid, end;
+        size_t found = 0;
+        clock_gettime (CLOCK_MONOTONIC, &start);
+        for (ssize_t i = 0; i < nmax; i++)
+          found += dict_contains (dt, -keys[i] - 1) == 1;
+        clock_gettime (CLOCK_MONOTONIC, &mid);
+        for (ssize_t i = 0; i < nmax; i++)
+          found += dict_contains (dt, lookups[i]) == 1;
+        clock_gettime (CLOCK_MONOTONIC, &end);
+        printf ("%10s %6.2f %12.1f %12.1f %12.1f\n", names[k],
+                (double)n / dt->dt_allocated_count,
+                diffnano (start, mid) / nmax, diffnano (mid, end) / nmax,
+                (double)dict_sizeof (dt) / dt->dt_allocated_count);
+        dict_free (dt);
+        if (found != (size_t)(nmax + 9) / 10)
+          fprintf (stderr, "unexpected hits: %zu\n", found);
+      }
+  free (lookups);
+  free (keys);
+}
+
+/*
+ * Growing inserts, hits and misses at one table size per index width: 1, 2
+ * and 4 byte slots (8 byte ones take over 2^32 slots). Small tables repeat
+ * their keys so that every row makes about `nops` calls of each kind.
+ */
+void
+bench_index_widths (ssize_t nops)
+{
+  static const ssize_t sizes[] = { 60, 20000, 2000000 };
+  static const index_kind_t kinds[] = { INDEX_COMPACT, INDEX_TAGGED };
+  static const char *names[] = { "compact", "tagged" };
+  char value[] = "value";
+  ssize_t nmax = sizes[sizeof (sizes) / sizeof (sizes[0]) - 1];
+  dkey_t *keys = SAFEMALLOC (sizeof (*keys) * nmax);
+  srandom (42);
+  for (ssize_t i = 0; i < nmax; i++)
+    keys[i] = randfrom (0, RAND_MAX);
+
+  printf ("%10s %9s %6s %12s %12s %12s\n", "index", "keys", "width",
+          "insert ns", "hit ns", "miss ns");
+  for (size_t s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++)
+    for (size_t k = 0; k < sizeof (kinds) / sizeof (kinds[0]); k++)
+      {
+        ssize_t n = sizes[s];
+        ssize_t rounds = nops / n > 0 ? nops / n : 1;
+        dict_config config = { .index_kind = kinds[k],
+                               .hash_kind = DICT_DEFAULT_HASH };
+        struct timespec start, end;
+        double insert_ns = 0, hit_ns, miss_ns;
+        size_t found = 0;
+        int width = 0;
+
+        for (ssize_t r = 0; r < rounds; r++)
+          {
+            dict *dt = dict_new_configured (0, &config);
+            clock_gettime (CLOCK_MONOTONIC, &start);
+            for (ssize_t i = 0; i < n; i++)
+              dict_insert (dt, keys[i], value);
+            clock_gettime (CLOCK_MONOTONIC, &end);
+            insert_ns += diffnano (start, end);
+            dict_free (dt);
+          }
+        dict *dt = dict_new_configured (0, &config);
+        for (ssize_t i = 0; i < n; i++)
+          dict_insert (dt, keys[i], value);
+        width = dt->dt_allocated_count <= 0xff     ? 1
+                : dt->dt_allocated_count <= 0xffff ? 2
+                                                   : 4;
+
+        clock_gettime (CLOCK_MONOTONIC, &start);
+        for (ssize_t r = 0; r < rounds; r++)
+          for (ssize_t i = 0; i < n; i++)
+            found += dict_contains (dt, keys[i]) == 1;
+        clock_gettime (CLOCK_MONOTONIC, &end);
+        hit_ns = diffnano (start, end);
+        clock_gettime (CLOCK_MONOTONIC, &start);
+        for (ssize_t r = 0; r < rounds; r++)
+          for (ssize_t i = 0; i < n; i++)
+            found += dict_contains (dt, -keys[i] - 1) == 1;
+        clock_gettime (CLOCK_MONOTONIC, &end);
+        miss_ns = diffnano (start, end);
+
+        printf ("%10s %9zd %6d %12.1f %12.1f %12.1f\n", names[k], n, width,
+                insert_ns / (rounds * n), hit_ns / (rounds * n),
+                miss_ns / (rounds * n));
+        dict_free (dt);
+        if (found != (size_t)(rounds * n))
+          fprintf (stderr, "unexpected hits: %zu\n", found);
+      }
+  free (keys);
+}
+
+/*
+ * A dict of `n` keys deleted down to 1% of them, with and without
+ * keep_tombstones: the time of the deletes and of the slowest one, then the
+ * size of what is left and the time dict_getkeys takes to walk it.
+ */
+void
+bench_compaction (ssize_t n)
+{
+  char value[] = "value";
+  dkey_t *keys = SAFEMALLOC (sizeof (*keys) * n);
+  srandom (42);
+  /* distinct keys, so that exactly one in a hundred is left */
+  for (ssize_t i = 0; i < n; i++)
+    keys[i] = (dkey_t)(uint32_t)(i * 2654435761u);
+
+  printf ("%16s %12s %14s %12s %12s %14s\n", "deletes", "delete ns",
+          "max delete us", "MiB before", "MiB after", "getkeys ms");
+  for (int keep = 1; keep >= 0; keep--)
+    {
+      dict_config config = { .index_kind = INDEX_COMPACT,
+                             .hash_kind = DICT_DEFAULT_HASH,
+                             .keep_tombstones = keep };
+      dict *dt = dict_new_configured (0, &config);
+      for (ssize_t i = 0; i < n; i++)
+        dict_insert (dt, keys[i], value);
+      double before = dict_sizeof (dt) / 1048576.0;
+
+      struct timespec start, end, t0, t1;
+      double slowest = 0;
+      clock_gettime (CLOCK_MONOTONIC, &start);
+      for (ssize_t i = 0; i < n; i++)
+        {
+          if (i % 100 == 0)
+            continue;
+          clock_gettime (CLOCK_MONOTONIC, &t0);
+          dict_delitem (dt, keys[i]);
+          clock_gettime (CLOCK_MONOTONIC, &t1);
+          if (diffnano (t0, t1) > slowest)
+            slowest = diffnano (t0, t1);
+        }
+      clock_gettime (CLOCK_MONOTONIC, &end);
+      double deletes = diffnano (start, end) / (n - (n + 99) / 100);
+
+      clock_gettime (CLOCK_MONOTONIC, &start);
+      keyset *ks = dict_getkeys (dt);
+      clock_gettime (CLOCK_MONOTONIC, &end);
+      printf ("%16s %12.1f %14.1f %12.1f %12.1f %14.3f\n",
+              keep ? "keep tombstones" : "compacting", deletes, slowest / 1e3,
+              before, dict_sizeof (dt) / 1048576.0, diffmilli (start, end));
+      if (ks->n_keys != (n + 99) / 100)
+        fprintf (stderr, "unexpected keys: %zd\n", ks->n_keys);
+      dict_freekeys (ks);
+      dict_free (dt);
+    }
+  free (keys);
+}
+
+/*
+ * Memory against lookup time for a few sizing policies. Each is measured at
+ * sizes spread over an octave above `n`, since where a size falls between
+ * two resizes decides its load; the figures are means over those sizes.
+ */
+void
+bench_load_factors (ssize_t n)
+{
+  const struct
+  {
+    const char *name;
+    double max_load, growth;
+  } policies[] = { { "0.5 / 2", 0.5, 2 },
+                   { "default", 0, 0 },
+                   { "0.75 / 2", 0.75, 2 },
+                   { "0.85 / 1.25", 0.85, 1.25 },
+                   { "0.9 / 1.1", 0.9, 1.1 } };
+  const int steps = 4;
+  char value[] = "value";
+  ssize_t most = 2 * n;
+  dkey_t *keys = SAFEMALLOC (sizeof (*keys) * 2 * most);
+  /* distinct keys; the second half are the misses */
+  for (ssize_t i = 0; i < 2 * most; i++)
+    keys[i] = (dkey_t)(uint32_t)(i * 2654435761u);
+
+  printf ("%18s %14s %12s %12s %14s\n", "max load / growth", "bytes/entry",
+          "hit ns", "miss ns", "insert ns");
+  for (size_t p = 0; p < sizeof (policies) / sizeof (policies[0]); p++)
+    {
+      double bytes = 0, hit = 0, miss = 0, insert = 0;
+      for (int step = 0; step < steps; step++)
+        {
+          ssize_t size = n + n * step / steps;
+          dict_config config = { .index_kind = INDEX_COMPACT,
+                                 .hash_kind = DICT_DEFAULT_HASH,
+                                 .max_load = policies[p].max_load,
+                                 .growth = policies[p].growth };
+          dict *dt = dict_new_configured (0, &config);
+          struct timespec start, end;
+          clock_gettime (CLOCK_MONOTONIC, &start);
+          for (ssize_t i = 0; i < size; i++)
+            dict_insert (dt, keys[i], value);
+          clock_gettime (CLOCK_MONOTONIC, &end);
+          insert += diffnano (start, end) / size;
+          bytes += (double)dict_sizeof (dt) / size;
+
+          ssize_t found = 0;
+          clock_gettime (CLOCK_MONOTONIC, &start);
+          for (ssize_t i = 0; i < size; i++)
+            found += dict_getvalue (dt, keys[i]) != NULL;
+          clock_gettime (CLOCK_MONOTONIC, &end);
+          hit += diffnano (start, end) / size;
+
+          clock_gettime (CLOCK_MONOTONIC, &start);
+          for (ssize_t i = 0; i < size; i++)
+            found += dict_getvalue (dt, keys[most + i]) != NULL;
+          clock_gettime (CLOCK_MONOTONIC, &end);
+          miss += diffnano (start, end) / size;
+          if (found != size)
+            fprintf (stderr, "unexpected hits: %zd\n", found);
+          dict_free (dt);
+        }
+      printf ("%18s %14.1f %12.1f %12.1f %14.1f\n", policies[p].name,
+              bytes / steps, hit / steps, miss / steps, insert / steps);
+    }
+  free (keys);
+}
@@ -0,0 +1,156 @@
+//
+// Hardware performance counters around benchmarked regions
+//
+
+#include "perf_counters.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+const char *const perf_event_names[PERF_EVENT_COUNT]
+    = { "instructions", "cache-misses", "LLC-misses", "dTLB-misses",
+        "branch-misses" };
+
+#ifdef __linux__
+
+#define HW_CACHE_MISS(cache)                                                  \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8)                               \
+   | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct
+{
+  uint32_t type;
+  uint64_t config;
+} perf_events[PERF_EVENT_COUNT] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  { PERF_TYPE_HW_CACHE, HW_CACHE_MISS (PERF_COUNT_HW_CACHE_LL) },
+  { PERF_TYPE_HW_CACHE, HW_CACHE_MISS (PERF_COUNT_HW_CACHE_DTLB) },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+/* the layout read () returns for the read_format used below */
+typedef struct perf_reading
+{
+  uint64_t value;
+  uint64_t time_enabled;
+  uint64_t time_running;
+} perf_reading;
+
+int
+perf_counters_open (perf_counters *pc)
+{
+  int opened = 0;
+  perf_counters_reset (pc);
+  for (int e = 0; e < PERF_EVENT_COUNT; e++)
+    {
+      struct perf_event_attr attr;
+      memset (&attr, 0, sizeof (attr));
+      attr.size = sizeof (attr);
+      attr.type = perf_events[e].type;
+      attr.config = perf_events[e].config;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format
+          = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      pc->pc_fds[e] = (int)syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0);
+      opened += pc->pc_fds[e] >= 0;
+    }
+  return opened;
+}
+
+void
+perf_counters_close (perf_counters *pc)
+{
+  for (int e = 0; e < PERF_EVENT_COUNT; e++)
+    {
+      if (pc->pc_fds[e] >= 0)
+        close (pc->pc_fds[e]);
+      pc->pc_fds[e] = -1;
+    }
+}
+
+/* PERF_EVENT_IOC_RESET only zeroes the count: the times add up since the
+   event was opened, so a start records them to scale the interval by */
+void
+perf_counters_start (perf_counters *pc)
+{
+  for (int e = 0; e < PERF_EVENT_COUNT; e++)
+    if (pc->pc_fds[e] >= 0)
+      {
+        perf_reading r = { 0, 0, 0 };
+        ioctl (pc->pc_fds[e], PERF_EVENT_IOC_RESET, 0);
+        if (read (pc->pc_fds[e], &r, sizeof (r)) != sizeof (r))
+          r = (perf_reading){ 0, 0, 0 };
+        pc->pc_enabled[e] = r.time_enabled;
+        pc->pc_running[e] = r.time_running;
+        ioctl (pc->pc_fds[e], PERF_EVENT_IOC_ENABLE, 0);
+      }
+}
+
+void
+perf_counters_stop (perf_counters *pc)
+{
+  for (int e = 0; e < PERF_EVENT_COUNT; e++)
+    if (pc->pc_fds[e] >= 0)
+      ioctl (pc->pc_fds[e], PERF_EVENT_IOC_DISABLE, 0);
+
+  for (int e = 0; e < PERF_EVENT_COUNT; e++)
+    {
+      perf_reading r;
+      if (pc->pc_fds[e] < 0
+          || read (pc->pc_fds[e], &r, sizeof (r)) != sizeof (r))
+        continue;
+      /* the event only ran for part of the interval if it was multiplexed */
+      uint64_t enabled = r.time_enabled - pc->pc_enabled[e];
+      uint64_t running = r.time_running - pc->pc_running[e];
+      if (running && running < enabled)
+        r.value = (uint64_t)((double)r.value * (double)enabled
+                             / (double)running);
+      pc->pc_counts[e] += r.value;
+    }
+}
+
+#else
+
+int
+perf_counters_open (perf_counters *pc)
+{
+  perf_counters_reset (pc);
+  for (int e = 0; e < PERF_EVENT_COUNT; e++)
+    pc->pc_fds[e] = -1;
+  return 0;
+}
+
+void
+perf_counters_close (perf_counters *pc)
+{
+  (void)pc;
+}
+
+void
+perf_counters_start (perf_counters *pc)
+{
+  (void)pc;
+}
+
+void
+perf_counters_stop (perf_counters *pc)
+{
+  (void)pc;
+}
+
+#endif
+
+void
+perf_counters_reset (perf_counters *pc)
+{
+  memset (pc->pc_counts, 0, sizeof (pc->pc_counts));
+}
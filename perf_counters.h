@@ -0,0 +1,68 @@
+//
+// Hardware performance counters around benchmarked regions
+//
+
+#ifndef HASHTABLE_PERF_COUNTERS_H
+#define HASHTABLE_PERF_COUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief The events counted by a perf_counters
+ *
+ */
+typedef enum {
+        PERF_INSTRUCTIONS,
+        PERF_CACHE_MISSES,
+        PERF_LLC_MISSES,
+        PERF_DTLB_MISSES,
+        PERF_BRANCH_MISSES,
+        PERF_EVENT_COUNT
+} perf_event_t;
+
+/* short names of the events, e.g. for benchmark counter labels */
+extern const char *const perf_event_names[PERF_EVENT_COUNT];
+
+/**
+ * @brief A set of per-thread event counters (Linux perf_event_open)
+ *
+ * Every event is opened on its own, so one the CPU or kernel does not
+ * support (LLC events in many VMs, everything under a restrictive
+ * perf_event_paranoid or seccomp policy) is simply reported as missing.
+ * Counts are scaled up when the kernel had to multiplex the events.
+ * On other systems all events are missing.
+ *
+ */
+typedef struct perf_counters
+{
+        int             pc_fds[PERF_EVENT_COUNT];       // -1 when unavailable
+        uint64_t        pc_counts[PERF_EVENT_COUNT];    // accumulated over start/stop pairs
+        uint64_t        pc_enabled[PERF_EVENT_COUNT];   // time_enabled at the last start
+        uint64_t        pc_running[PERF_EVENT_COUNT];   // time_running at the last start
+} perf_counters;
+
+/**
+ * @brief open the counters of the calling thread, initially stopped
+ *
+ * @return int the number of events that could be opened; 0 if none
+ */
+int perf_counters_open(perf_counters *pc);
+
+void perf_counters_close(perf_counters *pc);
+
+/* zero the accumulated counts */
+void perf_counters_reset(perf_counters *pc);
+
+void perf_counters_start(perf_counters *pc);
+
+/* stop counting and add what was counted since the start to pc_counts */
+void perf_counters_stop(perf_counters *pc);
+
+static inline bool
+perf_counters_available (const perf_counters *pc, perf_event_t e)
+{
+  return pc->pc_fds[e] >= 0;
+}
+
+#endif //HASHTABLE_PERF_COUNTERS_H
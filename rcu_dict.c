@@ -0,0 +1,256 @@
+//
+// A read-mostly dict whose readers take no locks
+//
+
+#include "rcu_dict.h"
+
+#include <sched.h>
+
+/* Whether inserting one more key would make `dt` reallocate its index
+   (NEEDS_RESIZING in dict.c) or its entry array (array_grow) in place */
+static inline bool
+insert_would_reallocate (const dict *dt)
+{
+  return dt->dt_free_count <= 0
+         || dt->dt_entries.ar_allocated_count
+                < dt->dt_entries.ar_used_count + 1;
+}
+
+rcu_dict *
+rcu_dict_new (const dict_config *config)
+{
+  if (config && (config->value_kind != VALUES_BORROWED || config->shrink_at))
+    {
+      /* values read from an owning dict die with its retired copy, and a
+         dict keeping its tombstones never compacts */
+      fprintf (stderr, "unsupported rcu_dict config\n");
+      return NULL;
+    }
+  rcu_dict *rd;
+  if (posix_memalign ((void **)&rd, 64, sizeof (rcu_dict)) != 0)
+    {
+      fprintf (stderr, "Out of memory\n");
+      return NULL;
+    }
+  dict_config c = config ? *config
+                          : (dict_config){ .hash_kind = DICT_DEFAULT_HASH };
+  c.index_kind = INDEX_COMPACT;
+  c.incremental_resize = false;
+  c.keep_tombstones = true;
+  *rd = (rcu_dict){ .rc_current = dict_new_configured (0, &c),
+                    .rc_epoch = 1,
+                    .rc_retired = NULL,
+                    .rc_config = c };
+  if (!rd->rc_current
+      || pthread_mutex_init (&rd->rc_writer_lock, NULL) != 0)
+    {
+      if (rd->rc_current)
+        dict_free (rd->rc_current);
+      free (rd);
+      return NULL;
+    }
+  return rd;
+}
+
+/* free every retired dict no reader can still be probing */
+static void
+rcu_dict_reclaim (rcu_dict *rd)
+{
+  uint64_t oldest = UINT64_MAX;
+  for (int i = 0; i < RCU_MAX_READERS; i++)
+    {
+      uint64_t e
+          = __atomic_load_n (&rd->rc_readers[i].rd_epoch, __ATOMIC_SEQ_CST);
+      if (e != 0 && e < oldest)
+        oldest = e;
+    }
+
+  /* a reader that entered in epoch e saw every dict published before e */
+  for (rcu_retired **p = &rd->rc_retired; *p;)
+    {
+      rcu_retired *r = *p;
+      if (r->rt_epoch <= oldest)
+        {
+          *p = r->rt_next;
+          dict_free (r->rt_dict);
+          free (r);
+        }
+      else
+        p = &r->rt_next;
+    }
+}
+
+/* replace rc_current by a copy with room for `growth` times its live
+   entries and retire it */
+static int
+rcu_dict_grow (rcu_dict *rd)
+{
+  dict *old = rd->rc_current;
+  double growth
+      = rd->rc_config.growth ? rd->rc_config.growth : DICT_DEFAULT_GROWTH;
+  /* as for entry arrays, a factor near 1 would copy on every few inserts */
+  if (growth < DICT_DEFAULT_ENTRY_GROWTH)
+    growth = DICT_DEFAULT_ENTRY_GROWTH;
+  dict *bigger = dict_new_configured (
+      (size_t)(dict_size (old) * growth) + MINSIZE, &rd->rc_config);
+  rcu_retired *r = SAFEMALLOC (sizeof (rcu_retired));
+  if (!bigger || !r || dict_update (bigger, old, 1) != 0)
+    {
+      if (bigger)
+        dict_free (bigger);
+      free (r);
+      return -1;
+    }
+
+  __atomic_store_n (&rd->rc_current, bigger, __ATOMIC_SEQ_CST);
+  *r = (rcu_retired){
+    .rt_dict = old,
+    .rt_epoch = __atomic_add_fetch (&rd->rc_epoch, 1, __ATOMIC_SEQ_CST),
+    .rt_next = rd->rc_retired,
+  };
+  rd->rc_retired = r;
+  return 0;
+}
+
+int
+rcu_dict_free (rcu_dict *rd)
+{
+  if (!rd)
+    {
+      fprintf (stderr, "NULL POINTER\n");
+      return -1;
+    }
+  while (rd->rc_retired)
+    {
+      rcu_retired *r = rd->rc_retired;
+      rd->rc_retired = r->rt_next;
+      dict_free (r->rt_dict);
+      free (r);
+    }
+  dict_free (rd->rc_current);
+  pthread_mutex_destroy (&rd->rc_writer_lock);
+  free (rd);
+  return 1;
+}
+
+rcu_reader *
+rcu_dict_register_reader (rcu_dict *rd)
+{
+  for (int i = 0; i < RCU_MAX_READERS; i++)
+    {
+      int expected = 0;
+      if (__atomic_compare_exchange_n (&rd->rc_readers[i].rd_in_use,
+                                       &expected, 1, false, __ATOMIC_ACQ_REL,
+                                       __ATOMIC_RELAXED))
+        return &rd->rc_readers[i];
+    }
+  fprintf (stderr, "too many readers\n");
+  return NULL;
+}
+
+void
+rcu_dict_unregister_reader (rcu_dict *rd, rcu_reader *reader)
+{
+  (void)rd;
+  __atomic_store_n (&reader->rd_epoch, 0, __ATOMIC_RELEASE);
+  __atomic_store_n (&reader->rd_in_use, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Enter a read-side section. The epoch must be announced before the current
+ * dict is loaded: the writer publishes before it bumps the epoch, so it will
+ * see either this announcement or a reader that only saw the new dict.
+ */
+static inline dict *
+rcu_read_lock (rcu_dict *rd, rcu_reader *reader)
+{
+  __atomic_store_n (&reader->rd_epoch,
+                    __atomic_load_n (&rd->rc_epoch, __ATOMIC_SEQ_CST),
+                    __ATOMIC_SEQ_CST);
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  return __atomic_load_n (&rd->rc_current, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+rcu_read_unlock (rcu_reader *reader)
+{
+  __atomic_store_n (&reader->rd_epoch, 0, __ATOMIC_RELEASE);
+}
+
+dval_t
+rcu_dict_getvalue (rcu_dict *rd, rcu_reader *reader, dkey_t key)
+{
+  if (!rd || !reader)
+    {
+      fprintf (stderr, "null pointer\n");
+      return NULL;
+    }
+  dict *dt = rcu_read_lock (rd, reader);
+  dval_t value = dict_getvalue (dt, key);
+  rcu_read_unlock (reader);
+  return value;
+}
+
+int
+rcu_dict_contains (rcu_dict *rd, rcu_reader *reader, dkey_t key)
+{
+  if (!rd || !reader)
+    return -1;
+  return rcu_dict_getvalue (rd, reader, key) != NULL;
+}
+
+int
+rcu_dict_insert (rcu_dict *rd, dkey_t key, dval_t value)
+{
+  if (!rd)
+    return INVALID_INPUT;
+  pthread_mutex_lock (&rd->rc_writer_lock);
+  if (insert_would_reallocate (rd->rc_current) && rcu_dict_grow (rd) != 0)
+    {
+      pthread_mutex_unlock (&rd->rc_writer_lock);
+      return INTERNAL_ERROR;
+    }
+  int ret = dict_insert (rd->rc_current, key, value);
+  if (rd->rc_retired)
+    rcu_dict_reclaim (rd);
+  pthread_mutex_unlock (&rd->rc_writer_lock);
+  return ret;
+}
+
+int
+rcu_dict_delitem (rcu_dict *rd, dkey_t key)
+{
+  if (!rd)
+    return -1;
+  pthread_mutex_lock (&rd->rc_writer_lock);
+  int ret = dict_delitem (rd->rc_current, key);
+  pthread_mutex_unlock (&rd->rc_writer_lock);
+  return ret;
+}
+
+ssize_t
+rcu_dict_size (rcu_dict *rd)
+{
+  if (!rd)
+    {
+      fprintf (stderr, "Error\n");
+      return -1;
+    }
+  pthread_mutex_lock (&rd->rc_writer_lock);
+  ssize_t n = dict_size (rd->rc_current);
+  pthread_mutex_unlock (&rd->rc_writer_lock);
+  return n;
+}
+
+void
+rcu_dict_synchronize (rcu_dict *rd)
+{
+  pthread_mutex_lock (&rd->rc_writer_lock);
+  for (rcu_dict_reclaim (rd); rd->rc_retired; rcu_dict_reclaim (rd))
+    {
+      pthread_mutex_unlock (&rd->rc_writer_lock);
+      sched_yield ();
+      pthread_mutex_lock (&rd->rc_writer_lock);
+    }
+  pthread_mutex_unlock (&rd->rc_writer_lock);
+}
@@ -0,0 +1,104 @@
+//
+// A read-mostly dict whose readers take no locks
+//
+
+#ifndef HASHTABLE_RCU_DICT_H
+#define HASHTABLE_RCU_DICT_H
+
+#include <pthread.h>
+
+#include "dict.h"
+
+/* The most reader threads an rcu_dict can have registered at once */
+#define RCU_MAX_READERS (128)
+
+/**
+ * @brief The announcement slot of one reader thread
+ *
+ * rd_epoch is the global epoch the reader saw when it entered its current
+ * read-side section, or 0 when it is outside of one. A reader only ever
+ * writes its own slot, which sits on a cache line of its own.
+ *
+ */
+typedef struct rcu_reader
+{
+        uint64_t        rd_epoch;
+        int             rd_in_use;
+} __attribute__ ((aligned (64))) rcu_reader;
+
+/**
+ * @brief A dict retired by the writer, freed once no reader can see it
+ *
+ */
+typedef struct rcu_retired
+{
+        dict*                   rt_dict;
+        uint64_t                rt_epoch;       // the epoch it was retired in
+        struct rcu_retired*     rt_next;
+} rcu_retired;
+
+/**
+ * @brief A dictionary for read-mostly workloads
+ *
+ * Lookups never lock and never write shared memory. Writers serialize on
+ * rc_writer_lock and update rc_current in place as long as neither its
+ * index nor its entry array has to be reallocated. When one would be, the
+ * writer builds a larger dict, publishes it, and retires the old one.
+ * Retired dicts are freed once every reader that might still be probing
+ * them has left its read-side section (epoch based reclamation). Deletes
+ * leave tombstones (keep_tombstones), since compacting would move entries
+ * under the readers.
+ *
+ */
+typedef struct rcu_dict
+{
+        dict*                   rc_current;
+        uint64_t                rc_epoch;
+        pthread_mutex_t         rc_writer_lock;
+        rcu_retired*            rc_retired;
+        dict_config             rc_config;
+        rcu_reader              rc_readers[RCU_MAX_READERS];
+} rcu_dict;
+
+/**
+ * @brief create a read-mostly dictionary
+ *
+ * @param config NULL for the defaults. The index is always INDEX_COMPACT and
+ * resizes are never incremental, whatever `config` asks for. Its allocator,
+ * max_load and growth apply to every published dict, each of which has room
+ * for growth times the live entries of the one it replaces. The values must
+ * be VALUES_BORROWED and shrink_at 0, as deletes never compact.
+ * @return rcu_dict*, or NULL for an unsupported config or out of memory
+ */
+rcu_dict *rcu_dict_new(const dict_config *config);
+
+/**
+ * @brief free `rd`; no reader may use it any more
+ */
+int rcu_dict_free(rcu_dict *rd);
+
+/**
+ * @brief claim a reader slot for the calling thread
+ *
+ * @return rcu_reader* to pass to the lookups, or NULL if all are taken
+ */
+rcu_reader *rcu_dict_register_reader(rcu_dict *rd);
+
+void rcu_dict_unregister_reader(rcu_dict *rd, rcu_reader *reader);
+
+dval_t rcu_dict_getvalue(rcu_dict *rd, rcu_reader *reader, dkey_t key);
+
+int rcu_dict_contains(rcu_dict *rd, rcu_reader *reader, dkey_t key);
+
+int rcu_dict_insert(rcu_dict *rd, dkey_t key, dval_t value);
+
+int rcu_dict_delitem(rcu_dict *rd, dkey_t key);
+
+ssize_t rcu_dict_size(rcu_dict *rd);
+
+/**
+ * @brief wait until every dict retired so far has been freed
+ */
+void rcu_dict_synchronize(rcu_dict *rd);
+
+#endif //HASHTABLE_RCU_DICT_H
@@ -0,0 +1,221 @@
+//
+// A dict split into 2^k independently locked shards
+//
+
+#include "sharded_dict.h"
+
+#include <string.h>
+
+#define SD_NUM_SHARDS(sd) ((size_t)1 << (sd)->sd_log2_shards)
+
+/* The hash of `key` under the hash function shared by every shard */
+#define SD_HASH(sd, key) dict_hash ((sd)->sd_shards[0].sh_dict, key)
+
+/* Fibonacci remix, so the shard bits do not depend on how well the
+   hash function spreads its own high bits */
+static inline shard *
+shard_of (sharded_dict *sd, hash_t h)
+{
+  if (sd->sd_log2_shards == 0)
+    return sd->sd_shards;
+  return &sd->sd_shards[(h * 0x9E3779B97F4A7C15ull)
+                        >> (64 - sd->sd_log2_shards)];
+}
+
+/* free `sd` along with its first `n` shards, their dicts and locks */
+static void
+free_shards (sharded_dict *sd, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      dict_free (sd->sd_shards[i].sh_dict);
+      pthread_rwlock_destroy (&sd->sd_shards[i].sh_lock);
+    }
+  free (sd->sd_shards);
+  free (sd);
+}
+
+sharded_dict *
+sharded_dict_new (unsigned log2_shards, const dict_config *config)
+{
+  dict_config defaults = { .index_kind = INDEX_COMPACT,
+                           .hash_kind = DICT_DEFAULT_HASH };
+  if (log2_shards >= 32)
+    {
+      fprintf (stderr, "too many shards\n");
+      return NULL;
+    }
+  if (!config)
+    config = &defaults;
+  if (config->value_kind != VALUES_BORROWED)
+    {
+      /* values in a shard's arena move or go away once its lock is
+         released, so readers could be handed dangling pointers */
+      fprintf (stderr, "a sharded dict can only borrow its values\n");
+      return NULL;
+    }
+
+  sharded_dict *sd = SAFEMALLOC (sizeof (sharded_dict));
+  if (!sd)
+    return NULL;
+  sd->sd_log2_shards = log2_shards;
+  if (posix_memalign ((void **)&sd->sd_shards, sizeof (shard),
+                      sizeof (shard) * SD_NUM_SHARDS (sd))
+      != 0)
+    {
+      free (sd);
+      return NULL;
+    }
+  for (size_t i = 0; i < SD_NUM_SHARDS (sd); i++)
+    {
+      shard *sh = &sd->sd_shards[i];
+      sh->sh_dict = dict_new_configured (0, config);
+      if (!sh->sh_dict || pthread_rwlock_init (&sh->sh_lock, NULL) != 0)
+        {
+          fprintf (stderr, "shard creation failed\n");
+          if (sh->sh_dict)
+            dict_free (sh->sh_dict);
+          free_shards (sd, i);
+          return NULL;
+        }
+    }
+  return sd;
+}
+
+int
+sharded_dict_free (sharded_dict *sd)
+{
+  if (!sd)
+    {
+      fprintf (stderr, "NULL POINTER\n");
+      return -1;
+    }
+  free_shards (sd, SD_NUM_SHARDS (sd));
+  return 1;
+}
+
+int
+sharded_dict_insert (sharded_dict *sd, dkey_t key, dval_t value)
+{
+  if (!sd)
+    return INVALID_INPUT;
+  hash_t h = SD_HASH (sd, key);
+  shard *sh = shard_of (sd, h);
+
+  pthread_rwlock_wrlock (&sh->sh_lock);
+  int ret = dict_insert_with_hash (sh->sh_dict, h, &key, &value);
+  pthread_rwlock_unlock (&sh->sh_lock);
+  return ret;
+}
+
+dval_t
+sharded_dict_getvalue (sharded_dict *sd, dkey_t key)
+{
+  if (!sd)
+    {
+      fprintf (stderr, "null pointer\n");
+      return NULL;
+    }
+  hash_t h = SD_HASH (sd, key);
+  shard *sh = shard_of (sd, h);
+
+  pthread_rwlock_rdlock (&sh->sh_lock);
+  dval_t value = dict_getvalue_knownhash (sh->sh_dict, h, key);
+  pthread_rwlock_unlock (&sh->sh_lock);
+  return value;
+}
+
+int
+sharded_dict_contains (sharded_dict *sd, dkey_t key)
+{
+  if (!sd)
+    return -1;
+  return sharded_dict_getvalue (sd, key) != NULL;
+}
+
+int
+sharded_dict_delitem (sharded_dict *sd, dkey_t key)
+{
+  if (!sd)
+    return -1;
+  shard *sh = shard_of (sd, SD_HASH (sd, key));
+
+  pthread_rwlock_wrlock (&sh->sh_lock);
+  int ret = dict_delitem (sh->sh_dict, key);
+  pthread_rwlock_unlock (&sh->sh_lock);
+  return ret;
+}
+
+ssize_t
+sharded_dict_size (sharded_dict *sd)
+{
+  if (!sd)
+    {
+      fprintf (stderr, "Error\n");
+      return -1;
+    }
+  ssize_t n = 0;
+  for (size_t i = 0; i < SD_NUM_SHARDS (sd); i++)
+    {
+      shard *sh = &sd->sd_shards[i];
+      pthread_rwlock_rdlock (&sh->sh_lock);
+      n += dict_size (sh->sh_dict);
+      pthread_rwlock_unlock (&sh->sh_lock);
+    }
+  return n;
+}
+
+keyset *
+sharded_dict_getkeys (sharded_dict *sd)
+{
+  if (!sd)
+    return NULL;
+  keyset *ko = SAFEMALLOC (sizeof (*ko));
+  *ko = (keyset){ .key = NULL, .n_keys = 0 };
+
+  for (size_t i = 0; i < SD_NUM_SHARDS (sd); i++)
+    {
+      shard *sh = &sd->sd_shards[i];
+      pthread_rwlock_rdlock (&sh->sh_lock);
+      keyset *ks = dict_getkeys (sh->sh_dict);
+      pthread_rwlock_unlock (&sh->sh_lock);
+
+      if (ks->n_keys > 0)
+        {
+          ko->key = SAFEREALLOC (ko->key,
+                                 sizeof (dkey_t) * (ko->n_keys + ks->n_keys));
+          memcpy (ko->key + ko->n_keys, ks->key, sizeof (dkey_t) * ks->n_keys);
+          ko->n_keys += ks->n_keys;
+        }
+      dict_freekeys (ks);
+    }
+  return ko;
+}
+
+itemset *
+sharded_dict_getitems (sharded_dict *sd)
+{
+  if (!sd)
+    return NULL;
+  itemset *it = SAFEMALLOC (sizeof (*it));
+  *it = (itemset){ .items = NULL, .n_items = 0 };
+
+  for (size_t i = 0; i < SD_NUM_SHARDS (sd); i++)
+    {
+      shard *sh = &sd->sd_shards[i];
+      pthread_rwlock_rdlock (&sh->sh_lock);
+      itemset *is = dict_getitems (sh->sh_dict);
+      pthread_rwlock_unlock (&sh->sh_lock);
+
+      if (is->n_items > 0)
+        {
+          it->items = SAFEREALLOC (it->items,
+                                   sizeof (item) * (it->n_items + is->n_items));
+          memcpy (it->items + it->n_items, is->items,
+                  sizeof (item) * is->n_items);
+          it->n_items += is->n_items;
+        }
+      dict_freeitems (is);
+    }
+  return it;
+}
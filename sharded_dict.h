@@ -0,0 +1,82 @@
+//
+// A dict split into 2^k independently locked shards
+//
+
+#ifndef HASHTABLE_SHARDED_DICT_H
+#define HASHTABLE_SHARDED_DICT_H
+
+#include <pthread.h>
+
+#include "dict.h"
+
+/**
+ * @brief One shard of a sharded_dict: a dict and the lock guarding it
+ *
+ * Shards are cache line aligned so that taking one shard's lock does not
+ * bounce the line holding its neighbour's.
+ *
+ */
+typedef struct shard
+{
+        pthread_rwlock_t        sh_lock;
+        dict*                   sh_dict;
+} __attribute__ ((aligned (64))) shard;
+
+/**
+ * @brief A thread safe dictionary made of 2^k independent dicts
+ *
+ * A key lives in the shard selected by the high bits of its (remixed)
+ * hash, which are independent of the low bits each shard masks with.
+ * Readers of a shard share its lock, writers hold it exclusively, and
+ * operations on different shards never contend.
+ *
+ */
+typedef struct sharded_dict
+{
+        shard*          sd_shards;
+        unsigned        sd_log2_shards;
+} sharded_dict;
+
+/**
+ * @brief create a sharded dictionary of 2^log2_shards shards
+ *
+ * @param config the configuration of every shard, or NULL for the defaults.
+ * Its value_kind must be VALUES_BORROWED
+ * @return sharded_dict*, or NULL if a shard could not be created
+ */
+sharded_dict *sharded_dict_new(unsigned log2_shards, const dict_config *config);
+
+int sharded_dict_free(sharded_dict *sd);
+
+int sharded_dict_insert(sharded_dict *sd, dkey_t key, dval_t value);
+
+dval_t sharded_dict_getvalue(sharded_dict *sd, dkey_t key);
+
+int sharded_dict_contains(sharded_dict *sd, dkey_t key);
+
+int sharded_dict_delitem(sharded_dict *sd, dkey_t key);
+
+/**
+ * @brief The total number of active entries over all shards
+ *
+ * @note
+ * Shards are counted one after the other, so with concurrent writers the
+ * result is not an atomic snapshot
+ */
+ssize_t sharded_dict_size(sharded_dict *sd);
+
+/**
+ * @brief The keys of all shards, shard by shard, each in insertion order
+ *
+ * @return keyset* to be released with dict_freekeys
+ */
+keyset *sharded_dict_getkeys(sharded_dict *sd);
+
+/**
+ * @brief The items of all shards, shard by shard, each in insertion order
+ *
+ * @return itemset* to be released with dict_freeitems
+ */
+itemset *sharded_dict_getitems(sharded_dict *sd);
+
+#endif //HASHTABLE_SHARDED_DICT_H
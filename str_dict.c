@@ -0,0 +1,253 @@
+//
+// A dict keyed by byte strings
+//
+
+#include "str_dict.h"
+
+#include <string.h>
+
+#include "hashes.h"
+
+#define GROW(t) ((t)->gd_active_count * 3)
+
+#define ARENA_MIN (256)
+
+/* a key being looked up, along with the arena the stored keys live in */
+typedef struct str_probe
+{
+  const char *sp_arena;
+  const char *sp_bytes;
+  size_t sp_len;
+} str_probe;
+
+/* the hash has already matched: the lengths and bytes of other keys are
+   rarely looked at */
+static inline bool
+str_key_eq (str_key stored, str_probe key)
+{
+  return stored.sk_len == key.sp_len
+         && memcmp (key.sp_arena + stored.sk_offset, key.sp_bytes, key.sp_len)
+                == 0;
+}
+
+GD_DEFINE_ALLOC (str_table)
+
+GD_DEFINE_PROBES (str_table, str_probe, str_key_eq, 8, int8_t)
+GD_DEFINE_PROBES (str_table, str_probe, str_key_eq, 16, int16_t)
+GD_DEFINE_PROBES (str_table, str_probe, str_key_eq, 32, int32_t)
+GD_DEFINE_PROBES (str_table, str_probe, str_key_eq, 64, int64_t)
+
+/* the position of the entry of `key`, or GD_EMPTY */
+static inline ssize_t
+str_dict_lookup (const str_dict *sd, hash_t hash, const char *key, size_t len)
+{
+  str_probe probe = { sd->sd_keys, key, len };
+  return GD_BY_WIDTH (&sd->sd_table, str_table_lookup, &sd->sd_table, hash,
+                      probe);
+}
+
+str_dict *
+str_dict_new (size_t nentries)
+{
+  str_dict *sd = SAFEMALLOC (sizeof (str_dict));
+  if (!sd)
+    return NULL;
+  *sd = (str_dict){ 0 };
+  str_table *t = &sd->sd_table;
+  if (str_table_alloc (t, GD_ESTIMATE_SIZE ((ssize_t)nentries)) != 0)
+    {
+      free (sd);
+      return NULL;
+    }
+  t->gd_free_count = GD_USABLE_FRACTION (t->gd_allocated_count);
+  return sd;
+}
+
+int
+str_dict_free (str_dict *sd)
+{
+  if (!sd)
+    {
+      fprintf (stderr, "NULL POINTER\n");
+      return -1;
+    }
+  free (sd->sd_table.gd_indices);
+  free (sd->sd_table.gd_entries);
+  free (sd->sd_keys);
+  free (sd);
+  return 1;
+}
+
+/*
+ * Rebuild for at least `minsize` slots, dropping the deleted entries and
+ * packing the keys of the others into an arena with room for `extra` bytes.
+ */
+static int
+str_dict_resize (str_dict *sd, ssize_t minsize, size_t extra)
+{
+  str_table *t = &sd->sd_table;
+  str_entry *old_entries = t->gd_entries;
+  void *old_indices = t->gd_indices;
+  char *old_keys = sd->sd_keys;
+  ssize_t old_used = t->gd_used_count;
+
+  size_t live = 0;
+  for (ssize_t j = 0; j < old_used; j++)
+    {
+      if (old_entries[j].ge_hashval != DELETED_HASH)
+        live += old_entries[j].ge_key.sk_len;
+    }
+  size_t capacity = ARENA_MIN;
+  while (capacity < 2 * (live + extra))
+    capacity <<= 1;
+  char *keys = SAFEMALLOC (capacity);
+  if (!keys)
+    return -1;
+  if (str_table_alloc (t, minsize) != 0)
+    {
+      free (keys);
+      return -1;
+    }
+
+  ssize_t used = 0;
+  size_t keys_used = 0;
+  for (ssize_t j = 0; j < old_used; j++)
+    {
+      str_entry *en = &old_entries[j];
+      if (en->ge_hashval == DELETED_HASH)
+        continue;
+      memcpy (keys + keys_used, old_keys + en->ge_key.sk_offset,
+              en->ge_key.sk_len);
+      t->gd_entries[used] = *en;
+      t->gd_entries[used].ge_key.sk_offset = keys_used;
+      keys_used += en->ge_key.sk_len;
+      used++;
+    }
+  GD_BY_WIDTH (t, str_table_build, t, used);
+  free (old_entries);
+  free (old_indices);
+  free (old_keys);
+  sd->sd_keys = keys;
+  sd->sd_keys_used = keys_used;
+  sd->sd_keys_capacity = capacity;
+  t->gd_used_count = used;
+  t->gd_free_count = GD_USABLE_FRACTION (t->gd_allocated_count) - used;
+  return 0;
+}
+
+/* make room for `len` more bytes of keys */
+static int
+reserve_keys (str_dict *sd, size_t len)
+{
+  if (sd->sd_keys && sd->sd_keys_used + len <= sd->sd_keys_capacity)
+    return 0;
+  size_t capacity = sd->sd_keys_capacity ? sd->sd_keys_capacity : ARENA_MIN;
+  while (capacity < sd->sd_keys_used + len)
+    capacity <<= 1;
+  char *keys = SAFEREALLOC (sd->sd_keys, capacity);
+  if (!keys)
+    return -1;
+  sd->sd_keys = keys;
+  sd->sd_keys_capacity = capacity;
+  return 0;
+}
+
+int
+str_dict_insert (str_dict *sd, const char *key, size_t len, dval_t value)
+{
+  if (!sd || !key || !value)
+    return INVALID_INPUT;
+  str_table *t = &sd->sd_table;
+  hash_t hash = hash_bytes (key, len);
+  ssize_t ix = str_dict_lookup (sd, hash, key, len);
+  if (ix >= 0)
+    {
+      t->gd_entries[ix].ge_value = value;
+      return OK_REPLACED;
+    }
+  if (t->gd_free_count <= 0)
+    {
+      if (str_dict_resize (sd, GROW (t), len) != 0)
+        return INTERNAL_ERROR;
+    }
+  else if (reserve_keys (sd, len) != 0)
+    return INTERNAL_ERROR;
+
+  memcpy (sd->sd_keys + sd->sd_keys_used, key, len);
+  t->gd_entries[t->gd_used_count]
+      = (str_entry){ hash, { sd->sd_keys_used, len }, value };
+  sd->sd_keys_used += len;
+  gd_set_index (t->gd_indices, t->gd_index_width,
+                GD_BY_WIDTH (t, str_table_find_empty_slot, t, hash),
+                t->gd_used_count);
+  t->gd_used_count++;
+  t->gd_active_count++;
+  t->gd_free_count--;
+  return OK;
+}
+
+dval_t
+str_dict_getvalue (str_dict *sd, const char *key, size_t len)
+{
+  if (!sd || !key)
+    {
+      fprintf (stderr, "null pointer\n");
+      return NULL;
+    }
+  ssize_t ix = str_dict_lookup (sd, hash_bytes (key, len), key, len);
+  return (ix >= 0) ? sd->sd_table.gd_entries[ix].ge_value : NULL;
+}
+
+int
+str_dict_contains (str_dict *sd, const char *key, size_t len)
+{
+  if (!sd || !key)
+    return -1;
+  return str_dict_lookup (sd, hash_bytes (key, len), key, len) >= 0;
+}
+
+int
+str_dict_delitem (str_dict *sd, const char *key, size_t len)
+{
+  if (!sd || !key)
+    return -1;
+  str_table *t = &sd->sd_table;
+  hash_t hash = hash_bytes (key, len);
+  ssize_t ix = str_dict_lookup (sd, hash, key, len);
+  if (ix < 0)
+    return -1;
+
+  gd_set_index (t->gd_indices, t->gd_index_width,
+                GD_BY_WIDTH (t, str_table_find_index, t, hash, ix), GD_DUMMY);
+  t->gd_entries[ix].ge_hashval = DELETED_HASH;
+  t->gd_entries[ix].ge_value = NULL;
+  t->gd_active_count--;
+  return 0;
+}
+
+ssize_t
+str_dict_size (str_dict *sd)
+{
+  if (!sd)
+    {
+      fprintf (stderr, "Error\n");
+      return -1;
+    }
+  return sd->sd_table.gd_active_count;
+}
+
+int
+str_dict_clear (str_dict *sd)
+{
+  if (!sd)
+    return -1;
+  free (sd->sd_table.gd_indices);
+  free (sd->sd_table.gd_entries);
+  free (sd->sd_keys);
+  *sd = (str_dict){ 0 };
+  if (str_table_alloc (&sd->sd_table, MINSIZE) != 0)
+    return -1;
+  sd->sd_table.gd_free_count
+      = GD_USABLE_FRACTION (sd->sd_table.gd_allocated_count);
+  return 0;
+}
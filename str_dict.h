@@ -0,0 +1,84 @@
+//
+// A dict keyed by byte strings
+//
+
+#ifndef HASHTABLE_STR_DICT_H
+#define HASHTABLE_STR_DICT_H
+
+#include "dict_generic.h"
+
+/**
+ * @brief A key of a str_dict: a range of its key arena
+ *
+ * The key is not a pointer but a range of sd_keys, so the table holds no
+ * heap pointer per key.
+ */
+typedef struct str_key
+{
+        size_t  sk_offset;      // of the key's first byte in sd_keys
+        size_t  sk_len;
+} str_key;
+
+/* the entries and table of a str_dict, laid out as by DICT_DECLARE */
+GD_DECLARE_TYPES (str_table, str_key, dval_t)
+
+typedef str_table_entry str_entry;
+
+/**
+ * @brief A dictionary keyed by strings of `len` bytes, NULs included
+ *
+ * Keys are hashed with hash_bytes and compared by hash, then by length,
+ * then byte by byte. Their bytes are copied into one growing arena,
+ * sd_keys; a resize drops the deleted entries and the bytes of their keys.
+ * The table is dict_generic.h's, probed by the loops it generates for each
+ * index width.
+ *
+ */
+typedef struct str_dict
+{
+        str_table       sd_table;
+        char*           sd_keys;                // the key arena
+        size_t          sd_keys_used;
+        size_t          sd_keys_capacity;
+} str_dict;
+
+/**
+ * @brief create a str_dict that holds `nentries` keys without resizing
+ *
+ * @return str_dict*, or NULL if out of memory
+ */
+str_dict *str_dict_new(size_t nentries);
+
+int str_dict_free(str_dict *sd);
+
+/**
+ * @brief insert the `len` bytes at `key` or overwrite their value
+ *
+ * @return int OK, OK_REPLACED, or INVALID_INPUT / INTERNAL_ERROR
+ */
+int str_dict_insert(str_dict *sd, const char *key, size_t len, dval_t value);
+
+/* the value of `key`, or NULL if it is absent */
+dval_t str_dict_getvalue(str_dict *sd, const char *key, size_t len);
+
+int str_dict_contains(str_dict *sd, const char *key, size_t len);
+
+/**
+ * @brief remove `key`
+ *
+ * @return int (0) if it was removed, (-1) if it was absent
+ */
+int str_dict_delitem(str_dict *sd, const char *key, size_t len);
+
+ssize_t str_dict_size(str_dict *sd);
+
+int str_dict_clear(str_dict *sd);
+
+/* the key of `en`, which is not NUL terminated */
+static inline const char *
+str_dict_key(const str_dict *sd, const str_entry *en)
+{
+        return sd->sd_keys + en->ge_key.sk_offset;
+}
+
+#endif //HASHTABLE_STR_DICT_H
@@ -1,11 +1,13 @@
 #include <cmath>
 #include <cstring>
+#include <vector>
 
 #include "gtest/gtest.h"
 
 extern "C"
 {
 #include "../dict.h"
+#include "../value_arena.h"
 }
 
 class HashTableCreationTest : public testing::Test
@@ -26,4 +28,887 @@ TEST (HashTableCreation, EmptyDictCreate)
 {
   dict *dt = dict_new_empty ();
   EXPECT_TRUE (dt != NULL);
-}
\ No newline at end of file
+}
+TEST (HashTableEntries, DeletedEntriesAreSkipped)
+{
+  dict *dt = dict_new_empty ();
+  char value[] = "v";
+  for (int i = 0; i < 100; i++)
+    EXPECT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+  for (int i = 0; i < 100; i += 2)
+    EXPECT_EQ (dict_delitem (dt, (dkey_t)i), 0);
+
+  EXPECT_EQ (dict_size (dt), 50);
+  keyset *keys = dict_getkeys (dt);
+  ASSERT_EQ (keys->n_keys, 50);
+  for (ssize_t i = 0; i < keys->n_keys; i++)
+    EXPECT_EQ (keys->key[i], (dkey_t)(2 * i + 1));
+  dict_freekeys (keys);
+
+  dict *copy = dict_copy (dt);
+  EXPECT_TRUE (dict_equal (dt, copy));
+  EXPECT_FALSE (dict_contains (copy, 0.0));
+  EXPECT_TRUE (dict_contains (copy, 99.0));
+  dict_free (copy);
+  dict_free (dt);
+}
+
+TEST (HashTableSwissIndex, InsertLookupDelete)
+{
+  dict *dt = dict_new_with_index (0, INDEX_SWISS);
+  char value[] = "v";
+  const int n = 5000;
+  for (int i = 0; i < n; i++)
+    EXPECT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+  EXPECT_EQ (dict_size (dt), n);
+  for (int i = 0; i < n; i++)
+    EXPECT_TRUE (dict_contains (dt, (dkey_t)i));
+  for (int i = n; i < 2 * n; i++)
+    EXPECT_FALSE (dict_contains (dt, (dkey_t)i));
+
+  for (int i = 0; i < n; i += 3)
+    EXPECT_EQ (dict_delitem (dt, (dkey_t)i), 0);
+  for (int i = 0; i < n; i++)
+    EXPECT_EQ (dict_contains (dt, (dkey_t)i), i % 3 != 0);
+
+  dict *copy = dict_copy (dt);
+  EXPECT_TRUE (dict_equal (dt, copy));
+  EXPECT_TRUE (dict_contains (copy, 1.0));
+  dict_free (copy);
+  dict_free (dt);
+}
+
+TEST (HashTableRobinHoodIndex, ChurnLeavesNoTombstones)
+{
+  dict *dt = dict_new_with_index (0, INDEX_ROBIN_HOOD);
+  char value[] = "v";
+  const int n = 5000;
+  for (int i = 0; i < n; i++)
+    EXPECT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+  EXPECT_EQ (dict_size (dt), n);
+  for (int i = 0; i < n; i++)
+    EXPECT_TRUE (dict_contains (dt, (dkey_t)i));
+  for (int i = n; i < 2 * n; i++)
+    EXPECT_FALSE (dict_contains (dt, (dkey_t)i));
+
+  /* replace every third key by a fresh one */
+  for (int i = 0; i < n; i += 3)
+    {
+      EXPECT_EQ (dict_delitem (dt, (dkey_t)i), 0);
+      EXPECT_EQ (dict_insert (dt, (dkey_t)(i + n), value), OK);
+    }
+  for (int i = 0; i < 2 * n; i++)
+    EXPECT_EQ (dict_contains (dt, (dkey_t)i),
+               i < n ? i % 3 != 0 : (i - n) % 3 == 0);
+
+  dict *copy = dict_copy (dt);
+  EXPECT_TRUE (dict_equal (dt, copy));
+  dict_free (copy);
+
+  /* every occupied slot still holds an entry after the deletes */
+  ssize_t occupied = 0;
+  for (ssize_t i = 0; i < dt->dt_allocated_count; i++)
+    occupied += dt->dt_ctrl[i] != 0;
+  EXPECT_EQ (occupied, dict_size (dt));
+
+  for (int i = 0; i < 2 * n; i++)
+    dict_delitem (dt, (dkey_t)i);
+  for (ssize_t i = 0; i < dt->dt_allocated_count; i++)
+    ASSERT_EQ (dt->dt_ctrl[i], 0);
+  dict_free (dt);
+}
+
+TEST (HashTableStats, ReportsTombstonesAndProbes)
+{
+  dict *dt = dict_new_empty ();
+  char value[] = "v";
+  for (int i = 0; i < 1000; i++)
+    dict_insert (dt, (dkey_t)i, value);
+  for (int i = 0; i < 1000; i += 4)
+    dict_delitem (dt, (dkey_t)i);
+  for (int i = 0; i < 2000; i++)
+    dict_contains (dt, (dkey_t)i);
+
+  dict_stats stats;
+  ASSERT_EQ (dict_get_stats (dt, &stats), 0);
+  EXPECT_EQ (stats.st_tombstones, 250);
+  EXPECT_DOUBLE_EQ (stats.st_tombstone_ratio, 0.25);
+  EXPECT_EQ (stats.st_entry_slack, dt->dt_entries.ar_allocated_count - 1000);
+
+  uint64_t hits = 0, misses = 0;
+  for (int k = 0; k < DICT_PROBE_BUCKETS; k++)
+    {
+      hits += stats.st_hit_probes[k];
+      misses += stats.st_miss_probes[k];
+    }
+#ifdef DICT_STATS
+  /* the 1000 inserts and 1250 lookups missed, 250 deletes and 750 hit */
+  EXPECT_EQ (hits, 1000u);
+  EXPECT_EQ (misses, 2250u);
+  EXPECT_GT (stats.st_resizes, 0u);
+#else
+  EXPECT_EQ (hits + misses, 0u);
+  EXPECT_EQ (stats.st_resizes, 0u);
+#endif
+  dict_free (dt);
+}
+
+TEST (HashTableStats, CountsProbesOfTheOldIndex)
+{
+  char value[] = "v";
+  for (index_kind_t kind :
+       { INDEX_COMPACT, INDEX_SWISS, INDEX_ROBIN_HOOD, INDEX_TAGGED })
+    {
+      dict_config config = { .index_kind = kind,
+                             .hash_kind = DICT_DEFAULT_HASH,
+                             .incremental_resize = true };
+      dict *dt = dict_new_configured (0, &config);
+      for (int i = 0; !dt->dt_old_indices; i++)
+        ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+
+      dict_stats before, after;
+      ASSERT_EQ (dict_get_stats (dt, &before), 0);
+      for (int i = 0; i < 100; i++)
+        EXPECT_FALSE (dict_contains (dt, -1.0 - i));
+      ASSERT_EQ (dict_get_stats (dt, &after), 0);
+      uint64_t misses = 0;
+      for (int k = 0; k < DICT_PROBE_BUCKETS; k++)
+        misses += after.st_miss_probes[k] - before.st_miss_probes[k];
+#ifdef DICT_STATS
+      /* each miss probes the new index and then the old one */
+      EXPECT_EQ (misses, 200u) << "index kind " << kind;
+#else
+      EXPECT_EQ (misses, 0u);
+#endif
+      dict_free (dt);
+    }
+}
+
+TEST (HashTableBatch, LookupBatchMatchesSingleLookups)
+{
+  char value[] = "v";
+  for (index_kind_t kind :
+       { INDEX_COMPACT, INDEX_SWISS, INDEX_ROBIN_HOOD, INDEX_TAGGED })
+    {
+      dict *dt = dict_new_with_index (0, kind);
+      dkey_t keys[100];
+      dval_t values[100];
+      bool found[100];
+      for (int i = 0; i < 100; i++)
+        {
+          keys[i] = (dkey_t)i;
+          if (i % 2 == 0)
+            dict_insert (dt, keys[i], value);
+        }
+      EXPECT_EQ (dict_lookup_batch (dt, keys, 100, values), 50);
+      EXPECT_EQ (dict_contains_batch (dt, keys, 100, found), 50);
+      for (int i = 0; i < 100; i++)
+        {
+          EXPECT_EQ (found[i], i % 2 == 0);
+          if (i % 2 == 0)
+            {
+              EXPECT_STREQ (values[i], value);
+            }
+          else
+            {
+              EXPECT_EQ (values[i], nullptr);
+            }
+        }
+      dict_free (dt);
+    }
+}
+
+TEST (HashTableCreation, InitializedLastWriterWins)
+{
+  char a[] = "a", b[] = "b", c[] = "c";
+  dkey_t keys[] = { 1.0, 2.0, 1.0, 3.0, 2.0 };
+  dval_t values[] = { a, a, b, c, c };
+  dict *dt = dict_new_initialized (keys, values, 5);
+  ASSERT_TRUE (dt != NULL);
+  EXPECT_EQ (dict_size (dt), 3);
+  EXPECT_STREQ (dict_getvalue (dt, 1.0), b);
+  EXPECT_STREQ (dict_getvalue (dt, 2.0), c);
+  EXPECT_STREQ (dict_getvalue (dt, 3.0), c);
+
+  keyset *ks = dict_getkeys (dt);
+  ASSERT_EQ (ks->n_keys, 3);
+  EXPECT_EQ (ks->key[0], 1.0);
+  EXPECT_EQ (ks->key[1], 2.0);
+  EXPECT_EQ (ks->key[2], 3.0);
+  dict_freekeys (ks);
+  dict_free (dt);
+}
+
+TEST (HashTableCreation, InitializedParallel)
+{
+  const int n = 1 << 17;
+  char v[] = "v";
+  dkey_t *keys = new dkey_t[n];
+  dval_t *values = new dval_t[n];
+  for (int i = 0; i < n; i++)
+    {
+      keys[i] = (dkey_t)(i % (n / 2));
+      values[i] = v;
+    }
+  dict *dt = dict_new_initialized_parallel (keys, values, n, 4);
+  EXPECT_EQ (dict_size (dt), n / 2);
+  for (int i = 0; i < n / 2; i++)
+    ASSERT_TRUE (dict_contains (dt, (dkey_t)i));
+  EXPECT_EQ (dict_insert (dt, (dkey_t)n, v), OK);
+  dict_free (dt);
+  delete[] keys;
+  delete[] values;
+}
+
+TEST (HashTableHash, FastHashRoundTrips)
+{
+  dict_config config = { .index_kind = INDEX_COMPACT, .hash_kind = HASH_FAST };
+  dict *dt = dict_new_configured (0, &config);
+  char value[] = "v";
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ (dict_insert (dt, i * 0.5, value), OK);
+  for (int i = 0; i < 1000; i++)
+    EXPECT_TRUE (dict_contains (dt, i * 0.5));
+  EXPECT_EQ (dict_hash (dt, 0.0), dict_hash (dt, -0.0));
+  EXPECT_TRUE (dict_contains (dt, -0.0));
+
+  /* a dict with a different hash must rehash rather than reuse hashes */
+  dict *other = dict_new_empty ();
+  EXPECT_EQ (dict_update (other, dt, 1), 0);
+  EXPECT_EQ (dict_size (other), 1000);
+  EXPECT_TRUE (dict_equal (other, dt));
+  EXPECT_TRUE (dict_equal (dt, other));
+  dict_free (other);
+  dict_free (dt);
+}
+
+TEST (HashTableHash, NullDictIsRejectedBeforeHashing)
+{
+  char value[] = "v";
+  EXPECT_EQ (dict_insert (nullptr, 1.0, value), INVALID_INPUT);
+  EXPECT_EQ (dict_getvalue (nullptr, 1.0), nullptr);
+  EXPECT_EQ (dict_delitem (nullptr, 1.0), -1);
+  EXPECT_EQ (dict_contains (nullptr, 1.0), -1);
+}
+
+TEST (HashTableHash, NegativeHashesTerminateProbing)
+{
+  /* negative keys have negative hashes; probing must still reach an empty
+     slot when looking up absent keys */
+  dict *dt = dict_new_empty ();
+  char value[] = "v";
+  for (int i = 1; i <= 100000; i++)
+    EXPECT_EQ (dict_insert (dt, -(double)i * 1e6 - 0.5, value), OK);
+  for (int i = 1; i <= 100000; i++)
+    {
+      EXPECT_TRUE (dict_contains (dt, -(double)i * 1e6 - 0.5));
+      EXPECT_FALSE (dict_contains (dt, -(double)i * 1e6 - 0.25));
+    }
+  dict_free (dt);
+}
+
+TEST (HashTableValues, InlineValuesAreCopies)
+{
+  dict *dt = dict_new_empty ();
+  char shortv[] = "short";
+  char longv[] = "a value longer than twenty two bytes";
+  for (int i = 0; i < 100; i++)
+    dict_insert (dt, (dkey_t)i, i % 2 ? longv : shortv);
+  EXPECT_EQ (dict_insert (dt, 0.0, longv), OK_REPLACED);
+  EXPECT_EQ (dict_delitem (dt, 1.0), 0);
+
+  dict *copy = dict_copy (dt);
+  EXPECT_TRUE (dict_equal (copy, dt));
+  shortv[0] = 'S';
+  longv[0] = 'A';
+#ifdef DICT_INLINE_VALUES
+  /* the dicts hold copies, which later writes to the strings leave alone */
+  EXPECT_STREQ (dict_getvalue (dt, 2.0), "short");
+  EXPECT_STREQ (dict_getvalue (copy, 3.0),
+                "a value longer than twenty two bytes");
+  EXPECT_EQ (sizeof (dt_entry), 40u);
+#else
+  EXPECT_EQ (dict_getvalue (dt, 2.0), shortv);
+  EXPECT_EQ (dict_getvalue (copy, 3.0), longv);
+#endif
+  EXPECT_STREQ (dict_getvalue (dt, 0.0), dict_getvalue (copy, 0.0));
+  EXPECT_EQ (dict_getvalue (copy, 1.0), nullptr);
+
+  /* overriding keys, with the same values or not, is not an error */
+  dict *merged = dict_merge (dt, copy, 1);
+  ASSERT_TRUE (merged != NULL);
+  EXPECT_TRUE (dict_equal (merged, copy));
+  EXPECT_EQ (dict_update (merged, dt, 1), 0);
+  dict_free (merged);
+  dict_free (copy);
+  EXPECT_EQ (dict_clear (dt), 0);
+  dict_free (dt);
+}
+
+TEST (HashTableValues, OwnedValuesAreCopiedAndInterned)
+{
+  for (value_kind_t kind : { VALUES_OWNED, VALUES_INTERNED })
+    {
+      dict_config config = { .index_kind = INDEX_COMPACT,
+                             .hash_kind = DICT_DEFAULT_HASH,
+                             .incremental_resize = false,
+                             .value_kind = kind };
+      dict *dt = dict_new_configured (0, &config);
+      char value[64];
+      for (int i = 0; i < 1000; i++)
+        {
+          snprintf (value, sizeof (value), "value %d of a dict of its own",
+                    i % 10);
+          ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+        }
+      strcpy (value, "changed");
+      EXPECT_STREQ (dict_getvalue (dt, 3.0), "value 3 of a dict of its own");
+      EXPECT_EQ (dict_getvalue (dt, 3.0) == dict_getvalue (dt, 13.0),
+                 kind == VALUES_INTERNED);
+
+      dict *copy = dict_copy (dt);
+      EXPECT_TRUE (dict_equal (copy, dt));
+      EXPECT_NE (dict_getvalue (copy, 3.0), dict_getvalue (dt, 3.0));
+      EXPECT_EQ (dict_free (copy), 1);
+
+      /* overwritten values are dead weight until a resize compacts them */
+      for (int round = 0; round < 100; round++)
+        for (int i = 0; i < 1000; i++)
+          {
+            snprintf (value, sizeof (value),
+                      "round %d value %d, too long to inline", round, i);
+            ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK_REPLACED);
+          }
+      for (int i = 1000; i < 5000; i++)
+        ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+      EXPECT_STREQ (dict_getvalue (dt, 7.0),
+                    "round 99 value 7, too long to inline");
+      EXPECT_LT (dt->dt_values->va_dead, dt->dt_values->va_used / 2);
+      EXPECT_LT (dt->dt_values->va_allocated, (size_t)1 << 20);
+
+      EXPECT_EQ (dict_clear (dt), 0);
+      EXPECT_EQ (dt->dt_values->va_used, 0u);
+      ASSERT_EQ (dict_insert (dt, 1.0, value), OK);
+      EXPECT_STREQ (dict_getvalue (dt, 1.0),
+                    "round 99 value 999, too long to inline");
+      dict_free (dt);
+    }
+}
+
+TEST (HashTableAllocator, AllMemoryGoesThroughTheAllocator)
+{
+  char value[] = "v";
+  for (index_kind_t kind :
+       { INDEX_COMPACT, INDEX_SWISS, INDEX_ROBIN_HOOD, INDEX_TAGGED })
+    {
+      alloc_stats stats = {};
+      dict_allocator counting = counting_allocator (&stats);
+      dict_config config = { .index_kind = kind,
+                             .hash_kind = DICT_DEFAULT_HASH,
+                             .incremental_resize = kind == INDEX_SWISS,
+                             .value_kind = VALUES_BORROWED,
+                             .allocator = &counting };
+      dict *dt = dict_new_configured (0, &config);
+      for (int i = 0; i < 10000; i++)
+        ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+      for (int i = 0; i < 10000; i += 2)
+        ASSERT_EQ (dict_delitem (dt, (dkey_t)i), 0);
+      EXPECT_GT (stats.as_allocs, 2u);
+      EXPECT_GT (stats.as_reallocs, 0u);
+      EXPECT_GE (stats.as_peak_bytes, stats.as_live_bytes);
+
+      /* the copy allocates from the same allocator */
+      size_t live = stats.as_live_bytes;
+      dict *copy = dict_copy (dt);
+      EXPECT_GT (stats.as_live_bytes, live);
+      EXPECT_EQ (dict_clear (copy), 0);
+      dict_free (copy);
+      EXPECT_EQ (stats.as_live_bytes, live);
+
+      dict_free (dt);
+      EXPECT_EQ (stats.as_live_bytes, 0u);
+      EXPECT_EQ (stats.as_frees, stats.as_allocs);
+    }
+}
+
+/* a counting allocator which fails once `budget` allocations are made */
+struct failing_allocator
+{
+  alloc_stats stats;
+  dict_allocator counting;
+  int budget;
+};
+
+static void *
+failing_alloc (void *ctx, size_t n)
+{
+  failing_allocator *f = (failing_allocator *)ctx;
+  return f->budget-- > 0 ? DICT_ALLOC (&f->counting, n) : nullptr;
+}
+
+static void *
+failing_realloc (void *ctx, void *p, size_t old_n, size_t n)
+{
+  failing_allocator *f = (failing_allocator *)ctx;
+  return f->budget-- > 0 ? DICT_REALLOC (&f->counting, p, old_n, n) : nullptr;
+}
+
+static void
+failing_free (void *ctx, void *p, size_t n)
+{
+  DICT_FREE (&((failing_allocator *)ctx)->counting, p, n);
+}
+
+TEST (HashTableAllocator, FailedConstructionFreesEverything)
+{
+  char value[] = "v";
+  for (index_kind_t kind : { INDEX_COMPACT, INDEX_SWISS })
+    for (int budget = 0; budget < 4; budget++)
+      {
+        failing_allocator f = {};
+        f.counting = counting_allocator (&f.stats);
+        dict_allocator failing = { failing_alloc, failing_realloc,
+                                   failing_free, &f };
+        dict_config config = { .index_kind = kind,
+                               .hash_kind = DICT_DEFAULT_HASH,
+                               .allocator = &failing };
+        f.budget = budget;
+        dict *dt = dict_new_configured (100, &config);
+        if (dt)
+          dict_free (dt);
+        EXPECT_EQ (f.stats.as_live_bytes, 0u) << budget;
+
+        f.budget = 1 << 30;
+        dt = dict_new_configured (0, &config);
+        for (int i = 0; i < 1000; i++)
+          ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+        size_t live = f.stats.as_live_bytes;
+        f.budget = budget;
+        dict *copy = dict_copy (dt);
+        if (copy)
+          dict_free (copy);
+        EXPECT_EQ (f.stats.as_live_bytes, live) << budget;
+        f.budget = 1 << 30;
+        dict_free (dt);
+        EXPECT_EQ (f.stats.as_live_bytes, 0u);
+      }
+}
+
+TEST (HashTableAllocator, FailedResizesKeepTheDictUsable)
+{
+  char value[] = "v";
+  for (index_kind_t kind :
+       { INDEX_COMPACT, INDEX_SWISS, INDEX_ROBIN_HOOD, INDEX_TAGGED })
+    for (bool incremental : { false, true })
+      {
+        failing_allocator f = {};
+        f.counting = counting_allocator (&f.stats);
+        dict_allocator failing = { failing_alloc, failing_realloc,
+                                   failing_free, &f };
+        dict_config config = { .index_kind = kind,
+                               .hash_kind = DICT_DEFAULT_HASH,
+                               .incremental_resize = incremental,
+                               .allocator = &failing };
+        f.budget = 1 << 30;
+        dict *dt = dict_new_configured (0, &config);
+        const int n = 4000;
+        std::vector<bool> in (2 * n);
+
+        /* inserts fail once the allocator does, and change nothing */
+        f.budget = 8;
+        int failures = 0;
+        for (int i = 0; i < n; i++)
+          {
+            int ret = dict_insert (dt, (dkey_t)i, value);
+            ASSERT_TRUE (ret == OK || ret == INTERNAL_ERROR) << ret;
+            in[i] = ret == OK;
+            failures += ret == INTERNAL_ERROR;
+          }
+        EXPECT_GT (failures, 0);
+        for (int i = 0; i < n; i++)
+          ASSERT_EQ (dict_contains (dt, (dkey_t)i), in[i])
+              << i << " of index kind " << kind;
+
+        /* so do the resizes after deletes compact the dict */
+        f.budget = 1 << 30;
+        for (int i = 0; i < n; i++)
+          {
+            ASSERT_EQ (dict_setdefault (dt, (dkey_t)i, value) != nullptr,
+                       true);
+            in[i] = true;
+          }
+        f.budget = 0;
+        for (int i = 0; i < n; i++)
+          if (i % 4)
+            {
+              ASSERT_EQ (dict_delitem (dt, (dkey_t)i), 0);
+              in[i] = false;
+            }
+        for (int i = n; i < 2 * n; i++)
+          {
+            int ret = dict_insert (dt, (dkey_t)i, value);
+            ASSERT_TRUE (ret == OK || ret == INTERNAL_ERROR) << ret;
+            in[i] = ret == OK;
+          }
+        for (int i = 0; i < 2 * n; i++)
+          ASSERT_EQ (dict_contains (dt, (dkey_t)i), in[i])
+              << i << " of index kind " << kind;
+
+        /* and the dict grows again once memory is back */
+        f.budget = 1 << 30;
+        for (int i = 0; i < 2 * n; i++)
+          ASSERT_EQ (dict_insert (dt, (dkey_t)i, value),
+                     in[i] ? OK_REPLACED : OK);
+        EXPECT_EQ (dict_size (dt), 2 * n);
+        dict_free (dt);
+        EXPECT_EQ (f.stats.as_live_bytes, 0u);
+      }
+}
+
+TEST (HashTableAllocator, HugePagesBackLargeArrays)
+{
+  char value[] = "v";
+  dict_config config = { .index_kind = INDEX_SWISS,
+                         .hash_kind = DICT_DEFAULT_HASH,
+                         .incremental_resize = true,
+                         .value_kind = VALUES_BORROWED,
+                         .allocator = &dict_hugepage_allocator };
+  dict *dt = dict_new_configured (0, &config);
+  /* the entries grow from malloc into huge mappings and between them */
+  for (int i = 0; i < 300000; i++)
+    ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+  EXPECT_EQ ((uintptr_t)dt->dt_entries.ar_items % DICT_HUGEPAGE_SIZE, 0u);
+  EXPECT_EQ ((uintptr_t)dt->dt_indices % DICT_HUGEPAGE_SIZE, 0u);
+  for (int i = 0; i < 300000; i++)
+    if (strcmp (dict_getvalue (dt, (dkey_t)i), value) != 0)
+      {
+        ADD_FAILURE () << "lost key " << i;
+        break;
+      }
+
+  dict *copy = dict_copy (dt);
+  EXPECT_TRUE (dict_equal (copy, dt));
+  dict_free (copy);
+  EXPECT_EQ (dict_clear (dt), 0);
+  EXPECT_EQ (dict_size (dt), 0);
+  dict_free (dt);
+}
+
+static char counts[10][2] = { "0", "1", "2", "3", "4",
+                              "5", "6", "7", "8", "9" };
+
+/* one more than the count `old` holds */
+static dval_t
+increment (dkey_t, dval_t old, void *calls)
+{
+  ++*(int *)calls;
+  return counts[old ? old[0] - '0' + 1 : 1];
+}
+
+TEST (HashTableUpsert, CountsAndDefaults)
+{
+  for (index_kind_t kind :
+       { INDEX_COMPACT, INDEX_SWISS, INDEX_ROBIN_HOOD, INDEX_TAGGED })
+    for (bool incremental : { false, true })
+      {
+        dict_config config = { .index_kind = kind,
+                               .hash_kind = DICT_DEFAULT_HASH,
+                               .incremental_resize = incremental };
+        dict *dt = dict_new_configured (0, &config);
+        int calls = 0;
+        /* key k is counted k % 10 times, with deletes leaving dummies */
+        for (int round = 1; round < 10; round++)
+          for (int k = 0; k < 2000; k++)
+            if (k % 10 >= round)
+              {
+                int expected = round == 1 ? OK : OK_REPLACED;
+                ASSERT_EQ (dict_upsert (dt, (dkey_t)k, increment, &calls),
+                           expected);
+              }
+        for (int k = 2000; k < 4000; k++)
+          dict_insert (dt, (dkey_t)k, counts[0]);
+        for (int k = 2000; k < 4000; k++)
+          dict_delitem (dt, (dkey_t)k);
+
+        EXPECT_EQ (dict_size (dt), 1800);
+        for (int k = 1; k < 2000; k++)
+          if (k % 10 && strcmp (dict_getvalue (dt, (dkey_t)k),
+                                counts[k % 10]) != 0)
+            {
+              ADD_FAILURE () << "wrong count for " << k;
+              break;
+            }
+        EXPECT_EQ (calls, 200 * (1 + 2 + 3 + 4 + 5 + 6 + 7 + 8 + 9));
+
+        /* setdefault leaves present keys alone */
+        EXPECT_STREQ (dict_setdefault (dt, 9.0, counts[0]), "9");
+        EXPECT_STREQ (dict_setdefault (dt, 10.0, counts[0]), "0");
+        EXPECT_STREQ (dict_setdefault (dt, 10.0, counts[5]), "0");
+        EXPECT_STREQ (dict_setdefault (dt, 2500.0, counts[5]), "5");
+        EXPECT_EQ (dict_size (dt), 1802);
+        dict_free (dt);
+      }
+}
+
+/* NULL for odd keys, and the count of `old` plus one for the others */
+static dval_t
+increment_even (dkey_t key, dval_t old, void *calls)
+{
+  if ((long)key % 2)
+    return nullptr;
+  return increment (key, old, calls);
+}
+
+TEST (HashTableUpsert, NullChangesNothing)
+{
+  char value[] = "v";
+  for (index_kind_t kind : { INDEX_COMPACT, INDEX_SWISS })
+    {
+      dict_config config = { .index_kind = kind,
+                             .hash_kind = DICT_DEFAULT_HASH };
+      dict *dt = dict_new_configured (0, &config);
+      int calls = 0;
+      for (int k = 0; k < 100; k++)
+        ASSERT_EQ (dict_upsert (dt, (dkey_t)k, increment_even, &calls),
+                   k % 2 ? INVALID_INPUT : OK);
+      EXPECT_EQ (dict_size (dt), 50);
+      for (int k = 0; k < 100; k++)
+        ASSERT_EQ (dict_contains (dt, (dkey_t)k), k % 2 == 0);
+
+      /* present keys keep their value, and can still be overwritten and
+         deleted */
+      for (int k = 100; k < 200; k++)
+        ASSERT_EQ (dict_insert (dt, (dkey_t)k, value), OK);
+      for (int k = 100; k < 200; k++)
+        ASSERT_EQ (dict_upsert (dt, (dkey_t)k, increment_even, &calls),
+                   k % 2 ? INVALID_INPUT : OK_REPLACED);
+      for (int k = 101; k < 200; k += 2)
+        {
+          ASSERT_STREQ (dict_getvalue (dt, (dkey_t)k), value);
+          ASSERT_EQ (dict_insert (dt, (dkey_t)k, counts[3]), OK_REPLACED);
+          ASSERT_EQ (dict_delitem (dt, (dkey_t)k), 0);
+        }
+
+      EXPECT_EQ (dict_setdefault (dt, 1000.0, nullptr), nullptr);
+      EXPECT_FALSE (dict_contains (dt, 1000.0));
+      EXPECT_STREQ (dict_setdefault (dt, 0.0, nullptr), "1");
+      EXPECT_EQ (dict_size (dt), 100);
+      dict_free (dt);
+    }
+}
+
+TEST (HashTableIndex, PresizedInsertsFindEveryKey)
+{
+  /* without resizes, every key is indexed by the insert path alone */
+  char value[] = "v";
+  for (index_kind_t kind :
+       { INDEX_COMPACT, INDEX_SWISS, INDEX_ROBIN_HOOD, INDEX_TAGGED })
+    {
+      dict *dt = dict_new_with_index (20000, kind);
+      for (int i = 0; i < 20000; i++)
+        ASSERT_EQ (dict_insert (dt, i * 0.37, value), OK);
+      for (int i = 0; i < 20000; i += 3)
+        ASSERT_EQ (dict_delitem (dt, i * 0.37), 0);
+      for (int i = 0; i < 20000; i += 3)
+        ASSERT_EQ (dict_insert (dt, i * 0.37, value), OK);
+      EXPECT_EQ (dict_size (dt), 20000);
+      for (int i = 0; i < 20000; i++)
+        if (dict_contains (dt, i * 0.37) != 1)
+          {
+            ADD_FAILURE () << "lost key " << i << " of index kind " << kind;
+            break;
+          }
+      dict_free (dt);
+    }
+}
+
+TEST (HashTableIncrementalResize, LookupsSeeBothIndices)
+{
+  char value[] = "v";
+  for (index_kind_t kind :
+       { INDEX_COMPACT, INDEX_SWISS, INDEX_ROBIN_HOOD, INDEX_TAGGED })
+    {
+      dict_config config = { .index_kind = kind,
+                             .hash_kind = DICT_DEFAULT_HASH,
+                             .incremental_resize = true };
+      dict *dt = dict_new_configured (0, &config);
+      const int n = 20000;
+      std::vector<bool> deleted (n);
+      bool rehashed = false;
+      for (int i = 0; i < n; i++)
+        {
+          ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+          rehashed |= dt->dt_old_indices != NULL;
+          if (i % 7 == 0)
+            {
+              ASSERT_EQ (dict_delitem (dt, (dkey_t)(i / 2)), 0);
+              deleted[i / 2] = true;
+            }
+        }
+      EXPECT_TRUE (rehashed);
+      for (int i = 0; i < n; i++)
+        ASSERT_EQ (dict_contains (dt, (dkey_t)i), !deleted[i]) << i;
+      dict *copy = dict_copy (dt);
+      EXPECT_TRUE (dict_equal (copy, dt));
+      dict_free (copy);
+      dict_free (dt);
+    }
+}
+
+TEST (HashTableCompaction, DeletesShrinkTheTable)
+{
+  char value[] = "v";
+  for (index_kind_t kind :
+       { INDEX_COMPACT, INDEX_SWISS, INDEX_ROBIN_HOOD, INDEX_TAGGED })
+    for (bool incremental : { false, true })
+      {
+        dict_config config = { .index_kind = kind,
+                               .hash_kind = DICT_DEFAULT_HASH,
+                               .incremental_resize = incremental };
+        dict *dt = dict_new_configured (0, &config);
+        const int n = 100000;
+        for (int i = 0; i < n; i++)
+          ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+        ssize_t peak_slots = dt->dt_allocated_count;
+
+        /* keep every 100th key, checking lookups while entries move */
+        for (int i = 0; i < n; i++)
+          {
+            if (i % 100 != 0)
+              {
+                ASSERT_EQ (dict_delitem (dt, (dkey_t)i), 0);
+              }
+            if (i % 1000 == 999)
+              for (int k = 0; k <= i; k += 37)
+                {
+                  ASSERT_EQ (dict_contains (dt, (dkey_t)k), k % 100 == 0)
+                      << k << " of index kind " << kind;
+                }
+          }
+        /* overwrites finish the compaction and the index rebuild */
+        for (int round = 0; round < 100; round++)
+          for (int i = 0; i < n; i += 100)
+            ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK_REPLACED);
+
+        EXPECT_EQ (dict_size (dt), n / 100);
+        EXPECT_EQ (dt->dt_used_count, n / 100);
+        EXPECT_LE (dt->dt_allocated_count * 16, peak_slots);
+        EXPECT_LE (dt->dt_entries.ar_allocated_count, 2 * n / 100);
+        keyset *keys = dict_getkeys (dt);
+        ASSERT_EQ (keys->n_keys, n / 100);
+        for (int j = 0; j < n / 100; j++)
+          ASSERT_EQ (keys->key[j], (dkey_t)(j * 100));
+        dict_freekeys (keys);
+        dict_free (dt);
+      }
+}
+
+TEST (HashTableCompaction, ChurnKeepsEntryPositionsInRange)
+{
+  char value[] = "v";
+  for (index_kind_t kind :
+       { INDEX_COMPACT, INDEX_SWISS, INDEX_ROBIN_HOOD, INDEX_TAGGED })
+    for (bool incremental : { false, true })
+      for (bool keep : { false, true })
+        {
+          dict_config config = { .index_kind = kind,
+                                 .hash_kind = DICT_DEFAULT_HASH,
+                                 .incremental_resize = incremental,
+                                 .keep_tombstones = keep };
+          dict *dt = dict_new_configured (0, &config);
+          /* 20 live keys, and far more entries than a 1 byte index holds */
+          for (int i = 0; i < 20; i++)
+            ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+          for (int i = 20; i < 5000; i++)
+            {
+              ASSERT_EQ (dict_delitem (dt, (dkey_t)(i - 20)), 0);
+              ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+            }
+          EXPECT_EQ (dict_size (dt), 20);
+          for (int i = 0; i < 5000; i++)
+            ASSERT_EQ (dict_contains (dt, (dkey_t)i), i >= 5000 - 20)
+                << i << " of index kind " << kind;
+          dict_free (dt);
+        }
+}
+
+TEST (HashTableSizing, LoadStaysUnderMaxLoad)
+{
+  char value[] = "v";
+  const double policies[][3] = { { 0, 0, 0 },
+                                 { 0.5, 4, 0.25 },
+                                 { 0.9, 1.25, 1 } };
+  for (index_kind_t kind :
+       { INDEX_COMPACT, INDEX_SWISS, INDEX_ROBIN_HOOD, INDEX_TAGGED })
+    for (bool incremental : { false, true })
+      for (const double *p : policies)
+        {
+          dict_config config = { .index_kind = kind,
+                                 .hash_kind = DICT_DEFAULT_HASH,
+                                 .incremental_resize = incremental,
+                                 .max_load = p[0],
+                                 .growth = p[1],
+                                 .shrink_at = p[2] };
+          dict *dt = dict_new_configured (0, &config);
+          ASSERT_NE (dt, nullptr);
+          double max_load = p[0] ? p[0] : DICT_DEFAULT_MAX_LOAD;
+          for (int i = 0; i < 20000; i++)
+            {
+              ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+              ASSERT_LE (dt->dt_active_entries_count,
+                         dt->dt_allocated_count * max_load)
+                  << i << " of index kind " << kind;
+            }
+          for (int i = 0; i < 20000; i += 2)
+            ASSERT_EQ (dict_delitem (dt, (dkey_t)i), 0);
+          for (int i = 0; i < 20000; i++)
+            ASSERT_EQ (dict_contains (dt, (dkey_t)i), i % 2)
+                << i << " of index kind " << kind;
+
+          dict *copy = dict_copy (dt);
+          EXPECT_EQ (copy->dt_max_load, dt->dt_max_load);
+          EXPECT_EQ (copy->dt_growth, dt->dt_growth);
+          EXPECT_EQ (copy->dt_shrink_at, dt->dt_shrink_at);
+          dict_free (copy);
+          dict_free (dt);
+        }
+}
+
+TEST (HashTableSizing, EntryArrayGrowsGeometrically)
+{
+  char value[] = "v";
+  alloc_stats stats = {};
+  dict_allocator counting = counting_allocator (&stats);
+  dict_config config = { .index_kind = INDEX_COMPACT,
+                         .hash_kind = DICT_DEFAULT_HASH,
+                         .allocator = &counting,
+                         .growth = 1.0001 };
+  dict *dt = dict_new_configured (1000, &config);
+  ASSERT_NE (dt, nullptr);
+  EXPECT_EQ (dt->dt_entries.ar_allocated_count, 1000);
+  for (int i = 0; i < 1000; i++)
+    ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+  EXPECT_EQ (stats.as_reallocs, 0u);
+
+  /* a growth near 1 still grows the entries by DICT_DEFAULT_ENTRY_GROWTH */
+  for (int i = 1000; i < 100000; i++)
+    ASSERT_EQ (dict_insert (dt, (dkey_t)i, value), OK);
+  EXPECT_LT (stats.as_reallocs, 100u);
+  dict_free (dt);
+}
+
+TEST (HashTableSizing, InvalidPoliciesAreRejected)
+{
+  const double policies[][3] = { { 1, 0, 0 },   { 1.5, 0, 0 }, { -0.5, 0, 0 },
+                                 { 0, 1, 0 },   { 0, 0.5, 0 }, { 0, 0, 1.5 },
+                                 { 0, 0, -1 } };
+  for (const double *p : policies)
+    {
+      dict_config config = { .index_kind = INDEX_COMPACT,
+                             .hash_kind = DICT_DEFAULT_HASH,
+                             .max_load = p[0],
+                             .growth = p[1],
+                             .shrink_at = p[2] };
+      EXPECT_EQ (dict_new_configured (0, &config), nullptr);
+    }
+}
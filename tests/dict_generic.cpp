@@ -0,0 +1,98 @@
+#include <cstdint>
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+extern "C"
+{
+#include "../dict_generic.h"
+}
+
+struct point
+{
+  int32_t x, y;
+};
+
+static hash_t
+point_hash (point p)
+{
+  /* deliberately weak, so probing has to resolve collisions */
+  return (hash_t)(p.x + p.y);
+}
+
+static int
+point_eq (point a, point b)
+{
+  return a.x == b.x && a.y == b.y;
+}
+
+static int
+str_eq (const char *a, const char *b)
+{
+  return strcmp (a, b) == 0;
+}
+
+static hash_t
+str_hash (const char *s)
+{
+  hash_t h = 14695981039346656037ull;
+  for (; *s; s++)
+    h = (h ^ (unsigned char)*s) * 1099511628211ull;
+  return h;
+}
+
+DICT_DECLARE (point_dict, point, double)
+DICT_DEFINE (point_dict, point, double, point_hash, point_eq)
+
+DICT_DECLARE (str_dict, const char *, int64_t)
+DICT_DEFINE (str_dict, const char *, int64_t, str_hash, str_eq)
+
+TEST (DictGeneric, StructKeys)
+{
+  point_dict *pd = point_dict_new (0);
+  const int n = 100;
+  for (int x = 0; x < n; x++)
+    for (int y = 0; y < n; y++)
+      EXPECT_EQ (point_dict_insert (pd, point{ x, y }, x * 0.5 + y), OK);
+  EXPECT_EQ (point_dict_size (pd), n * n);
+  EXPECT_EQ (point_dict_insert (pd, point{ 3, 4 }, -1.0), OK_REPLACED);
+  EXPECT_EQ (*point_dict_get (pd, point{ 3, 4 }), -1.0);
+  EXPECT_EQ (*point_dict_get (pd, point{ 4, 3 }), 5.0);
+  EXPECT_EQ (point_dict_get (pd, point{ n, 0 }), nullptr);
+
+  for (int x = 0; x < n; x += 2)
+    for (int y = 0; y < n; y++)
+      EXPECT_EQ (point_dict_delitem (pd, point{ x, y }), 0);
+  EXPECT_EQ (point_dict_delitem (pd, point{ 0, 0 }), -1);
+  EXPECT_EQ (point_dict_size (pd), n * n / 2);
+  for (int x = 0; x < n; x++)
+    EXPECT_EQ (point_dict_contains (pd, point{ x, x }), x % 2);
+
+  /* iteration visits the live entries in insertion order */
+  ssize_t pos = 0, seen = 0;
+  int last = -1;
+  for (point_dict_entry *en; (en = point_dict_next (pd, &pos)); seen++)
+    {
+      int order = en->ge_key.x * n + en->ge_key.y;
+      EXPECT_GT (order, last);
+      EXPECT_EQ (en->ge_key.x % 2, 1);
+      last = order;
+    }
+  EXPECT_EQ (seen, n * n / 2);
+
+  EXPECT_EQ (point_dict_clear (pd), 0);
+  EXPECT_EQ (point_dict_size (pd), 0);
+  point_dict_free (pd);
+}
+
+TEST (DictGeneric, StringKeysCompareByContent)
+{
+  str_dict *sd = str_dict_new (4);
+  char a[] = "apple", b[] = "apple";
+  EXPECT_EQ (str_dict_insert (sd, a, 1), OK);
+  EXPECT_EQ (str_dict_insert (sd, b, 2), OK_REPLACED);
+  EXPECT_EQ (str_dict_size (sd), 1);
+  EXPECT_EQ (*str_dict_get (sd, "apple"), 2);
+  EXPECT_FALSE (str_dict_contains (sd, "pear"));
+  str_dict_free (sd);
+}
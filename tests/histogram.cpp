@@ -0,0 +1,44 @@
+#include "gtest/gtest.h"
+
+extern "C"
+{
+#include "../histogram.h"
+}
+
+TEST (Histogram, BucketsCoverTheirValues)
+{
+  for (uint64_t v : { 0ull, 1ull, 31ull, 32ull, 63ull, 64ull, 1000ull,
+                      123456789ull, ~0ull })
+    {
+      unsigned b = histogram_bucket (v);
+      ASSERT_LT (b, (unsigned)HISTOGRAM_BUCKETS);
+      if (v > 0)
+        {
+          EXPECT_LE (histogram_bucket (v - 1), b);
+        }
+    }
+  /* small values are exact */
+  EXPECT_NE (histogram_bucket (30), histogram_bucket (31));
+}
+
+TEST (Histogram, Percentiles)
+{
+  static histogram h;
+  histogram_reset (&h);
+  EXPECT_EQ (histogram_percentile (&h, 0.5), 0u);
+
+  for (uint64_t v = 1; v <= 100000; v++)
+    histogram_record (&h, v);
+  EXPECT_EQ (h.hg_total, 100000u);
+  EXPECT_EQ (h.hg_max, 100000u);
+
+  /* within the 1/32 bucket precision, and never below the true value */
+  for (double p : { 0.5, 0.99, 0.999 })
+    {
+      double exact = p * 100000;
+      uint64_t got = histogram_percentile (&h, p);
+      EXPECT_GE ((double)got, exact);
+      EXPECT_LE ((double)got, exact * (1 + 1.0 / HISTOGRAM_SUB_COUNT) + 1);
+    }
+  EXPECT_EQ (histogram_percentile (&h, 1.0), 100000u);
+}
@@ -0,0 +1,56 @@
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+extern "C"
+{
+#include "../int_dict.h"
+}
+
+TEST (IntDict, InsertLookupDelete)
+{
+  int_dict *id = int_dict_new (0);
+  char a[] = "a", b[] = "b";
+  const int64_t n = 10000;
+  for (int64_t i = 0; i < n; i++)
+    EXPECT_EQ (int_dict_insert (id, i * 7 - n, a), OK);
+  EXPECT_EQ (int_dict_size (id), n);
+  EXPECT_EQ (int_dict_insert (id, -n, b), OK_REPLACED);
+  EXPECT_EQ (int_dict_getvalue (id, -n), b);
+
+  for (int64_t i = 0; i < n; i += 2)
+    EXPECT_EQ (int_dict_delitem (id, i * 7 - n), 0);
+  EXPECT_EQ (int_dict_delitem (id, -n), -1);
+  EXPECT_EQ (int_dict_size (id), n / 2);
+
+  /* deleted entries are dropped when the table next grows */
+  for (int64_t i = n; i < 3 * n; i++)
+    int_dict_insert (id, i * 7 - n, a);
+  EXPECT_EQ (id->gd_used_count, id->gd_active_count);
+  for (int64_t i = 0; i < 3 * n; i++)
+    EXPECT_EQ (int_dict_contains (id, i * 7 - n), i >= n || i % 2 == 1);
+
+  EXPECT_EQ (int_dict_clear (id), 0);
+  EXPECT_EQ (int_dict_size (id), 0);
+  EXPECT_FALSE (int_dict_contains (id, 7 - n));
+  int_dict_free (id);
+}
+
+TEST (IntDict, KeysBeyondDoublePrecision)
+{
+  int_dict *id = int_dict_new (16);
+  char a[] = "a", b[] = "b", c[] = "c", d[] = "d";
+  const int64_t big = (int64_t)1 << 53;
+  /* big and big + 1 are the same double */
+  EXPECT_EQ (int_dict_insert (id, big, a), OK);
+  EXPECT_EQ (int_dict_insert (id, big + 1, b), OK);
+  EXPECT_EQ (int_dict_insert (id, INT64_MIN, c), OK);
+  EXPECT_EQ (int_dict_insert (id, INT64_MAX, d), OK);
+  EXPECT_EQ (int_dict_getvalue (id, big), a);
+  EXPECT_EQ (int_dict_getvalue (id, big + 1), b);
+  EXPECT_EQ (int_dict_getvalue (id, INT64_MIN), c);
+  EXPECT_EQ (int_dict_getvalue (id, INT64_MAX), d);
+  EXPECT_EQ (int_dict_getvalue (id, 0), nullptr);
+  EXPECT_EQ (int_dict_insert (id, 0, nullptr), INVALID_INPUT);
+  int_dict_free (id);
+}
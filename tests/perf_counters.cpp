@@ -0,0 +1,40 @@
+#include "gtest/gtest.h"
+
+extern "C"
+{
+#include "../perf_counters.h"
+}
+
+TEST (PerfCounters, CountOrDegradeGracefully)
+{
+  perf_counters pc;
+  int opened = perf_counters_open (&pc);
+  EXPECT_GE (opened, 0);
+  EXPECT_LE (opened, PERF_EVENT_COUNT);
+
+  volatile uint64_t sink = 0;
+  for (int round = 0; round < 2; round++)
+    {
+      perf_counters_start (&pc);
+      for (int i = 0; i < 100000; i++)
+        sink = sink + i;
+      perf_counters_stop (&pc);
+    }
+
+  for (int e = 0; e < PERF_EVENT_COUNT; e++)
+    {
+      if (!perf_counters_available (&pc, (perf_event_t)e))
+        {
+          EXPECT_EQ (pc.pc_counts[e], 0u);
+        }
+    }
+  if (perf_counters_available (&pc, PERF_INSTRUCTIONS))
+    {
+      EXPECT_GT (pc.pc_counts[PERF_INSTRUCTIONS], 200000u);
+    }
+
+  perf_counters_reset (&pc);
+  for (int e = 0; e < PERF_EVENT_COUNT; e++)
+    EXPECT_EQ (pc.pc_counts[e], 0u);
+  perf_counters_close (&pc);
+}
@@ -0,0 +1,107 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+extern "C"
+{
+#include "../rcu_dict.h"
+}
+
+TEST (RcuDict, SingleThreaded)
+{
+  rcu_dict *rd = rcu_dict_new (NULL);
+  rcu_reader *reader = rcu_dict_register_reader (rd);
+  ASSERT_NE (reader, nullptr);
+  char value[] = "v";
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ (rcu_dict_insert (rd, (dkey_t)i, value), OK);
+  for (int i = 0; i < 1000; i += 2)
+    EXPECT_EQ (rcu_dict_delitem (rd, (dkey_t)i), 0);
+  EXPECT_EQ (rcu_dict_size (rd), 500);
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ (rcu_dict_contains (rd, reader, (dkey_t)i), i % 2);
+
+  rcu_dict_synchronize (rd);
+  EXPECT_EQ (rd->rc_retired, nullptr);
+  rcu_dict_unregister_reader (rd, reader);
+  rcu_dict_free (rd);
+}
+
+TEST (RcuDict, ReadersDuringGrowth)
+{
+#ifdef DICT_INLINE_VALUES
+  GTEST_SKIP () << "values point into entries the writer may free";
+#endif
+  rcu_dict *rd = rcu_dict_new (NULL);
+  static char value[] = "v";
+  const int preloaded = 1000, total = 200000, nreaders = 3;
+  for (int i = 0; i < preloaded; i++)
+    rcu_dict_insert (rd, (dkey_t)i, value);
+
+  std::atomic<bool> done (false);
+  std::atomic<long> misses (0);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < nreaders; t++)
+    readers.emplace_back ([rd, &done, &misses] {
+      rcu_reader *reader = rcu_dict_register_reader (rd);
+      unsigned k = 0;
+      while (!done.load ())
+        {
+          if (rcu_dict_getvalue (rd, reader, (dkey_t)(k++ % preloaded))
+              != value)
+            misses++;
+        }
+      rcu_dict_unregister_reader (rd, reader);
+    });
+
+  for (int i = preloaded; i < total; i++)
+    rcu_dict_insert (rd, (dkey_t)i, value);
+  done = true;
+  for (auto &th : readers)
+    th.join ();
+
+  EXPECT_EQ (misses.load (), 0);
+  EXPECT_EQ (rcu_dict_size (rd), total);
+  rcu_dict_synchronize (rd);
+  EXPECT_EQ (rd->rc_retired, nullptr);
+  rcu_dict_free (rd);
+}
+
+TEST (RcuDict, ConfigAppliesToPublishedDicts)
+{
+  alloc_stats stats = {};
+  dict_allocator counting = counting_allocator (&stats);
+  dict_config config = { .index_kind = INDEX_SWISS,
+                         .hash_kind = DICT_DEFAULT_HASH,
+                         .allocator = &counting,
+                         .max_load = 0.5,
+                         .growth = 4 };
+  rcu_dict *rd = rcu_dict_new (&config);
+  ASSERT_NE (rd, nullptr);
+  char value[] = "v";
+  for (int i = 0; i < 10000; i++)
+    ASSERT_EQ (rcu_dict_insert (rd, (dkey_t)i, value), OK);
+  dict *dt = rd->rc_current;
+  EXPECT_EQ (dt->dt_index_kind, INDEX_COMPACT);
+  EXPECT_EQ (dt->dt_alloc, &counting);
+  EXPECT_EQ (dt->dt_max_load, 0.5);
+  EXPECT_EQ (dt->dt_growth, 4);
+  EXPECT_LE (dt->dt_active_entries_count, dt->dt_allocated_count * 0.5);
+  EXPECT_GT (stats.as_live_bytes, 0u);
+  rcu_dict_free (rd);
+  EXPECT_EQ (stats.as_live_bytes, 0u);
+}
+
+TEST (RcuDict, UnsupportedConfigsAreRejected)
+{
+  dict_config owned = { .index_kind = INDEX_COMPACT,
+                        .hash_kind = DICT_DEFAULT_HASH,
+                        .value_kind = VALUES_OWNED };
+  EXPECT_EQ (rcu_dict_new (&owned), nullptr);
+  dict_config shrinking = { .index_kind = INDEX_COMPACT,
+                            .hash_kind = DICT_DEFAULT_HASH,
+                            .shrink_at = 0.5 };
+  EXPECT_EQ (rcu_dict_new (&shrinking), nullptr);
+}
@@ -0,0 +1,106 @@
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+extern "C"
+{
+#include "../sharded_dict.h"
+}
+
+TEST (ShardedDict, SingleThreaded)
+{
+  sharded_dict *sd = sharded_dict_new (3, NULL);
+  char value[] = "v";
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ (sharded_dict_insert (sd, (dkey_t)i, value), OK);
+  for (int i = 0; i < 1000; i += 2)
+    EXPECT_EQ (sharded_dict_delitem (sd, (dkey_t)i), 0);
+  EXPECT_EQ (sharded_dict_size (sd), 500);
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ (sharded_dict_contains (sd, (dkey_t)i), i % 2);
+
+  keyset *ks = sharded_dict_getkeys (sd);
+  EXPECT_EQ (ks->n_keys, 500);
+  dict_freekeys (ks);
+  itemset *it = sharded_dict_getitems (sd);
+  EXPECT_EQ (it->n_items, 500);
+  dict_freeitems (it);
+  sharded_dict_free (sd);
+}
+
+TEST (ShardedDict, ConcurrentWriters)
+{
+  sharded_dict *sd = sharded_dict_new (4, NULL);
+  static char value[] = "v";
+  const int nthreads = 4, per_thread = 20000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nthreads; t++)
+    threads.emplace_back ([sd, t] {
+      for (int i = 0; i < per_thread; i++)
+        sharded_dict_insert (sd, (dkey_t)(t * per_thread + i), value);
+      for (int i = 0; i < per_thread; i += 4)
+        sharded_dict_delitem (sd, (dkey_t)(t * per_thread + i));
+    });
+  for (auto &th : threads)
+    th.join ();
+
+  EXPECT_EQ (sharded_dict_size (sd), nthreads * per_thread * 3 / 4);
+  for (int i = 0; i < nthreads * per_thread; i++)
+    ASSERT_EQ (sharded_dict_contains (sd, (dkey_t)i), i % 4 != 0);
+  sharded_dict_free (sd);
+}
+
+/* counts into the alloc_stats behind it, and fails after `budget` calls */
+struct budget_allocator
+{
+  alloc_stats stats;
+  dict_allocator counting;
+  int budget;
+};
+
+static void *
+budget_alloc (void *ctx, size_t n)
+{
+  budget_allocator *b = (budget_allocator *)ctx;
+  return b->budget-- > 0 ? DICT_ALLOC (&b->counting, n) : nullptr;
+}
+
+static void *
+budget_realloc (void *ctx, void *p, size_t old_n, size_t n)
+{
+  budget_allocator *b = (budget_allocator *)ctx;
+  return b->budget-- > 0 ? DICT_REALLOC (&b->counting, p, old_n, n) : nullptr;
+}
+
+static void
+budget_free (void *ctx, void *p, size_t n)
+{
+  DICT_FREE (&((budget_allocator *)ctx)->counting, p, n);
+}
+
+TEST (ShardedDict, FailedShardReturnsNull)
+{
+  budget_allocator b = {};
+  b.counting = counting_allocator (&b.stats);
+  /* enough for a few shards, not for all eight */
+  b.budget = 10;
+  dict_allocator failing = { budget_alloc, budget_realloc, budget_free, &b };
+  dict_config config = { .index_kind = INDEX_COMPACT,
+                         .hash_kind = DICT_DEFAULT_HASH,
+                         .allocator = &failing };
+  EXPECT_EQ (sharded_dict_new (3, &config), nullptr);
+  EXPECT_GT (b.stats.as_allocs, 0u);
+  EXPECT_EQ (b.stats.as_live_bytes, 0u);
+}
+
+TEST (ShardedDict, OwnedValuesAreRejected)
+{
+  for (value_kind_t kind : { VALUES_OWNED, VALUES_INTERNED })
+    {
+      dict_config config = { .index_kind = INDEX_COMPACT,
+                             .hash_kind = DICT_DEFAULT_HASH,
+                             .value_kind = kind };
+      EXPECT_EQ (sharded_dict_new (2, &config), nullptr);
+    }
+}
@@ -0,0 +1,66 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+extern "C"
+{
+#include "../str_dict.h"
+}
+
+TEST (StrDict, InsertLookupDelete)
+{
+  str_dict *sd = str_dict_new (0);
+  char a[] = "a", b[] = "b";
+  std::vector<std::string> keys;
+  /* lengths on both sides of every hash_bytes case: 0-3, 4-16, 17-47, 48+ */
+  for (int i = 0; i < 5000; i++)
+    keys.push_back (std::string (i % 131, 'k') + std::to_string (i));
+  for (const std::string &k : keys)
+    EXPECT_EQ (str_dict_insert (sd, k.data (), k.size (), a), OK);
+  EXPECT_EQ (str_dict_size (sd), (ssize_t)keys.size ());
+  EXPECT_EQ (str_dict_insert (sd, keys[7].data (), keys[7].size (), b),
+             OK_REPLACED);
+  EXPECT_EQ (str_dict_getvalue (sd, keys[7].data (), keys[7].size ()), b);
+
+  for (size_t i = 0; i < keys.size (); i += 2)
+    EXPECT_EQ (str_dict_delitem (sd, keys[i].data (), keys[i].size ()), 0);
+  EXPECT_EQ (str_dict_delitem (sd, keys[0].data (), keys[0].size ()), -1);
+
+  /* growing drops the deleted keys from the arena */
+  for (int i = 5000; i < 20000; i++)
+    {
+      std::string k = std::to_string (i);
+      str_dict_insert (sd, k.data (), k.size (), a);
+    }
+  EXPECT_EQ (sd->sd_table.gd_used_count, sd->sd_table.gd_active_count);
+  for (size_t i = 0; i < keys.size (); i++)
+    EXPECT_EQ (str_dict_contains (sd, keys[i].data (), keys[i].size ()),
+               (int)(i % 2));
+  for (ssize_t i = 0; i < sd->sd_table.gd_used_count; i++)
+    {
+      const str_entry *en = &sd->sd_table.gd_entries[i];
+      EXPECT_EQ (
+          str_dict_getvalue (sd, str_dict_key (sd, en), en->ge_key.sk_len),
+          en->ge_value);
+    }
+
+  EXPECT_EQ (str_dict_clear (sd), 0);
+  EXPECT_EQ (str_dict_size (sd), 0);
+  str_dict_free (sd);
+}
+
+TEST (StrDict, KeysAreLengthDelimited)
+{
+  str_dict *sd = str_dict_new (4);
+  char a[] = "a", b[] = "b", c[] = "c";
+  EXPECT_EQ (str_dict_insert (sd, "", 0, a), OK);
+  EXPECT_EQ (str_dict_insert (sd, "ab\0c", 4, b), OK);
+  EXPECT_EQ (str_dict_insert (sd, "ab\0d", 4, c), OK);
+  EXPECT_EQ (str_dict_getvalue (sd, "", 0), a);
+  EXPECT_EQ (str_dict_getvalue (sd, "ab\0c", 4), b);
+  EXPECT_EQ (str_dict_getvalue (sd, "ab\0d", 4), c);
+  EXPECT_EQ (str_dict_getvalue (sd, "ab", 2), nullptr);
+  EXPECT_EQ (str_dict_insert (sd, "x", 1, nullptr), INVALID_INPUT);
+  str_dict_free (sd);
+}
@@ -0,0 +1,166 @@
+//
+// A bump pointer arena for the value strings a dict owns
+//
+
+#include "value_arena.h"
+
+#include "hashes.h"
+
+static hash_t
+intern_hash (const char *s)
+{
+  return hash_bytes (s, strlen (s));
+}
+
+static int
+intern_eq (const char *a, const char *b)
+{
+  return strcmp (a, b) == 0;
+}
+
+DICT_DEFINE (intern_set, const char *, const char *, intern_hash, intern_eq)
+
+/* the data of chunk `c` */
+#define CHUNK_DATA(c) ((char *)((c) + 1))
+
+value_arena *
+value_arena_new (bool intern)
+{
+  value_arena *va = SAFEMALLOC (sizeof (value_arena));
+  if (!va)
+    return NULL;
+  *va = (value_arena){ 0 };
+  if (intern && !(va->va_interned = intern_set_new (0)))
+    {
+      free (va);
+      return NULL;
+    }
+  return va;
+}
+
+static void
+free_chunks (value_arena *va)
+{
+  arena_chunk *c = va->va_chunks;
+  while (c)
+    {
+      arena_chunk *next = c->ac_next;
+      free (c);
+      c = next;
+    }
+  va->va_chunks = NULL;
+  va->va_used = va->va_dead = va->va_allocated = 0;
+}
+
+void
+value_arena_free (value_arena *va)
+{
+  if (!va)
+    return;
+  free_chunks (va);
+  if (va->va_interned)
+    intern_set_free (va->va_interned);
+  free (va);
+}
+
+int
+value_arena_reset (value_arena *va)
+{
+  if (!va)
+    return -1;
+  free_chunks (va);
+  if (va->va_interned)
+    return intern_set_clear (va->va_interned);
+  return 0;
+}
+
+/* `n` bytes from the newest chunk, or from a new one */
+static char *
+arena_alloc (value_arena *va, size_t n)
+{
+  arena_chunk *c = va->va_chunks;
+  if (!c || c->ac_size - c->ac_used < n)
+    {
+      size_t size = n > ARENA_CHUNK_SIZE ? n : ARENA_CHUNK_SIZE;
+      arena_chunk *fresh = SAFEMALLOC (sizeof (arena_chunk) + size);
+      if (!fresh)
+        return NULL;
+      *fresh = (arena_chunk){ .ac_size = size };
+      va->va_allocated += size;
+      /* a string with a chunk of its own leaves the current chunk open */
+      if (c && size > ARENA_CHUNK_SIZE)
+        {
+          fresh->ac_next = c->ac_next;
+          c->ac_next = fresh;
+        }
+      else
+        {
+          fresh->ac_next = c;
+          va->va_chunks = fresh;
+        }
+      c = fresh;
+    }
+  char *p = CHUNK_DATA (c) + c->ac_used;
+  c->ac_used += n;
+  va->va_used += n;
+  return p;
+}
+
+char *
+value_arena_store (value_arena *va, const char *s)
+{
+  if (!va || !s)
+    return NULL;
+  if (va->va_interned)
+    {
+      const char **seen = intern_set_get (va->va_interned, s);
+      if (seen)
+        return (char *)*seen;
+    }
+  size_t n = strlen (s) + 1;
+  char *p = arena_alloc (va, n);
+  if (!p)
+    return NULL;
+  memcpy (p, s, n);
+  if (va->va_interned && intern_set_insert (va->va_interned, p, p) != OK)
+    return NULL;
+  return p;
+}
+
+void
+value_arena_release (value_arena *va, const char *s)
+{
+  if (va && s)
+    va->va_dead += strlen (s) + 1;
+}
+
+void
+value_arena_adopt (value_arena *va, value_arena *other)
+{
+  arena_chunk **tail = &va->va_chunks;
+  while (*tail)
+    tail = &(*tail)->ac_next;
+  *tail = other->va_chunks;
+  va->va_used += other->va_used;
+  va->va_dead += other->va_dead;
+  va->va_allocated += other->va_allocated;
+  other->va_chunks = NULL;
+  value_arena_free (other);
+}
+
+size_t
+value_arena_sizeof (const value_arena *va)
+{
+  if (!va)
+    return 0;
+  size_t t = sizeof (value_arena) + va->va_allocated;
+  for (arena_chunk *c = va->va_chunks; c; c = c->ac_next)
+    t += sizeof (arena_chunk);
+  if (va->va_interned)
+    t += sizeof (intern_set)
+         + va->va_interned->gd_allocated_count
+               * va->va_interned->gd_index_width
+         + GD_USABLE_FRACTION (va->va_interned->gd_allocated_count)
+               * sizeof (intern_set_entry);
+  return t;
+}
@@ -0,0 +1,85 @@
+//
+// A bump pointer arena for the value strings a dict owns
+//
+
+#ifndef HASHTABLE_VALUE_ARENA_H
+#define HASHTABLE_VALUE_ARENA_H
+
+#include "dict_generic.h"
+
+/* Bytes of a chunk; longer strings get a chunk of their own */
+#define ARENA_CHUNK_SIZE ((size_t)64 << 10)
+
+/**
+ * @brief A block of the arena, followed by its `ac_size` bytes of data
+ *
+ */
+typedef struct arena_chunk
+{
+        struct arena_chunk*     ac_next;
+        size_t                  ac_size;
+        size_t                  ac_used;
+} arena_chunk;
+
+/* the interned strings of an arena, each mapped to itself */
+DICT_DECLARE (intern_set, const char *, const char *)
+
+/**
+ * @brief Strings copied end to end into a list of chunks
+ *
+ * Strings are never freed one at a time: value_arena_release only counts
+ * their bytes as dead, and the owner copies the live ones into a new arena
+ * once enough are (value_arena_wants_compaction). Freeing the arena takes
+ * one free per chunk.
+ *
+ * An interning arena stores each distinct string once; storing an equal
+ * string again returns the first copy. Released strings stay interned until
+ * the next compaction, and since a shared copy is counted dead as soon as
+ * one user releases it, va_dead is an estimate.
+ *
+ */
+typedef struct value_arena
+{
+        arena_chunk*    va_chunks;      // the newest one first
+        size_t          va_used;        // bytes handed out
+        size_t          va_dead;        // of those, bytes released
+        size_t          va_allocated;   // bytes of all chunks
+        intern_set*     va_interned;    // NULL unless interning
+} value_arena;
+
+/**
+ * @brief create an empty arena
+ *
+ * @return value_arena*, or NULL if out of memory
+ */
+value_arena *value_arena_new(bool intern);
+
+void value_arena_free(value_arena *va);
+
+/* free every string, keeping the arena usable */
+int value_arena_reset(value_arena *va);
+
+/**
+ * @brief a copy of `s` owned by the arena
+ *
+ * @return char*, or NULL if out of memory
+ */
+char *value_arena_store(value_arena *va, const char *s);
+
+/* count the bytes of `s`, stored in `va`, as dead */
+void value_arena_release(value_arena *va, const char *s);
+
+/* move the chunks of `other` into `va` and free `other` */
+void value_arena_adopt(value_arena *va, value_arena *other);
+
+/* whether copying the live strings out would free at least half the arena */
+static inline bool
+value_arena_wants_compaction(const value_arena *va)
+{
+        return va->va_used >= ARENA_CHUNK_SIZE && va->va_dead >= va->va_used / 2;
+}
+
+/* the bytes taken by `va`, its chunks and intern set included */
+size_t value_arena_sizeof(const value_arena *va);
+
+#endif //HASHTABLE_VALUE_ARENA_H